@@ -1,731 +1,3589 @@
-#define F_CPU 16000000UL
-
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <util/delay.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <avr/sleep.h>
-
-
-// LCD interface
-//   make sure that the LCD RW pin is connected to GND
-#define lcd_D7_port     PORTD                   // lcd D7 connection
-#define lcd_D7_bit      PORTD7
-#define lcd_D7_ddr      DDRD
-
-#define lcd_D6_port     PORTD                   // lcd D6 connection
-#define lcd_D6_bit      PORTD6
-#define lcd_D6_ddr      DDRD
-
-#define lcd_D5_port     PORTD                   // lcd D5 connection
-#define lcd_D5_bit      PORTD5
-#define lcd_D5_ddr      DDRD
-
-#define lcd_D4_port     PORTD                   // lcd D4 connection
-#define lcd_D4_bit      PORTD4
-#define lcd_D4_ddr      DDRD
-
-#define lcd_E_port      PORTB                   // lcd Enable pin
-#define lcd_E_bit       PORTB1
-#define lcd_E_ddr       DDRB
-
-#define lcd_RS_port     PORTB                   // lcd Register Select pin
-#define lcd_RS_bit      PORTB0
-#define lcd_RS_ddr      DDRB
-
-// LCD module information
-#define lcd_LineOne     0x00                    // start of line 1
-#define lcd_LineTwo     0x40                    // start of line 2
-//#define   lcd_LineThree   0x14                  // start of line 3 (20x4)
-//#define   lcd_lineFour    0x54                  // start of line 4 (20x4)
-//#define   lcd_LineThree   0x10                  // start of line 3 (16x4)
-//#define   lcd_lineFour    0x50                  // start of line 4 (16x4)
-
-// LCD instructions
-#define lcd_Clear           0b00000001          // replace all characters with ASCII 'space'
-#define lcd_Home            0b00000010          // return cursor to first position on first line
-#define lcd_EntryMode       0b00000110          // shift cursor from left to right on read/write
-#define lcd_DisplayOff      0b00001000          // turn display off
-#define lcd_DisplayOn       0b00001100          // display on, cursor off, don't blink character
-#define lcd_FunctionReset   0b00110000          // reset the LCD
-#define lcd_FunctionSet4bit 0b00101000          // 4-bit data, 2-line display, 5 x 7 font
-#define lcd_SetCursor       0b10000000          // set cursor position
-
-// Program ID
-uint8_t czas = 30;
-uint8_t write30[]   = "030";
-uint8_t write0[]   = "0";
-uint8_t write1[]   = "1";
-uint8_t write2[]   = "2";
-uint8_t write3[]   = "3";
-uint8_t write4[]   = "4";
-uint8_t write5[]   = "5";
-uint8_t write6[]   = "6";
-uint8_t write7[]   = "7";
-uint8_t write8[]   = "8";
-uint8_t write9[]   = "9";
-uint8_t writee[]   = "e";
-uint8_t temp;
-uint8_t lower;
-uint8_t mid;
-uint8_t upper;
-// Function Prototypes
-void lcd_write_4(uint8_t);
-void lcd_write_instruction_4d(uint8_t);
-void lcd_write_character_4d(uint8_t);
-void lcd_write_string_4d(uint8_t *);
-void lcd_init_4d(void);
-
-/*============================== 4-bit LCD Functions ======================*/
-/*
-  Name:     lcd_init_4d
-  Purpose:  initialize the LCD module for a 4-bit data interface
-  Entry:    equates (LCD instructions) set up for the desired operation
-  Exit:     no parameters
-  Notes:    uses time delays rather than checking the busy flag
-*/
-void lcd_init_4d(void)
-{
-// Power-up delay
-    _delay_ms(100);                                 // initial 40 mSec delay
-
-// IMPORTANT - At this point the LCD module is in the 8-bit mode and it is expecting to receive  
-//   8 bits of data, one bit on each of its 8 data lines, each time the 'E' line is pulsed.
-//
-// Since the LCD module is wired for the 4-bit mode, only the upper four data lines are connected to 
-//   the microprocessor and the lower four data lines are typically left open.  Therefore, when 
-//   the 'E' line is pulsed, the LCD controller will read whatever data has been set up on the upper 
-//   four data lines and the lower four data lines will be high (due to internal pull-up circuitry).
-//
-// Fortunately the 'FunctionReset' instruction does not care about what is on the lower four bits so  
-//   this instruction can be sent on just the four available data lines and it will be interpreted 
-//   properly by the LCD controller.  The 'lcd_write_4' subroutine will accomplish this if the 
-//   control lines have previously been configured properly.
-
-// Set up the RS and E lines for the 'lcd_write_4' subroutine.
-    lcd_RS_port &= ~(1<<lcd_RS_bit);                // select the Instruction Register (RS low)
-    lcd_E_port &= ~(1<<lcd_E_bit);                  // make sure E is initially low
-
-// Reset the LCD controller
-    lcd_write_4(lcd_FunctionReset);                 // first part of reset sequence
-    _delay_ms(10);                                  // 4.1 mS delay (min)
-
-    lcd_write_4(lcd_FunctionReset);                 // second part of reset sequence
-    _delay_us(200);                                 // 100uS delay (min)
-
-    lcd_write_4(lcd_FunctionReset);                 // third part of reset sequence
-    _delay_us(200);                                 // this delay is omitted in the data sheet
-
-// Preliminary Function Set instruction - used only to set the 4-bit mode.
-// The number of lines or the font cannot be set at this time since the controller is still in the
-//  8-bit mode, but the data transfer mode can be changed since this parameter is determined by one 
-//  of the upper four bits of the instruction.
- 
-    lcd_write_4(lcd_FunctionSet4bit);               // set 4-bit mode
-    _delay_us(80);                                  // 40uS delay (min)
-
-// Function Set instruction
-    lcd_write_instruction_4d(lcd_FunctionSet4bit);   // set mode, lines, and font
-    _delay_us(80);                                  // 40uS delay (min)
-
-// The next three instructions are specified in the data sheet as part of the initialization routine, 
-//  so it is a good idea (but probably not necessary) to do them just as specified and then redo them 
-//  later if the application requires a different configuration.
-
-// Display On/Off Control instruction
-    lcd_write_instruction_4d(lcd_DisplayOff);        // turn display OFF
-    _delay_us(80);                                  // 40uS delay (min)
-
-// Clear Display instruction
-    lcd_write_instruction_4d(lcd_Clear);             // clear display RAM
-    _delay_ms(4);                                   // 1.64 mS delay (min)
-
-// ; Entry Mode Set instruction
-    lcd_write_instruction_4d(lcd_EntryMode);         // set desired shift characteristics
-    _delay_us(80);                                  // 40uS delay (min)
-
-// This is the end of the LCD controller initialization as specified in the data sheet, but the display
-//  has been left in the OFF condition.  This is a good time to turn the display back ON.
- 
-// Display On/Off Control instruction
-    lcd_write_instruction_4d(lcd_DisplayOn);         // turn the display ON
-    _delay_us(80);                                  // 40uS delay (min)
-}
-
-/*...........................................................................
-  Name:     lcd_write_string_4d
-; Purpose:  display a string of characters on the LCD
-  Entry:    (theString) is the string to be displayed
-  Exit:     no parameters
-  Notes:    uses time delays rather than checking the busy flag
-*/
-void lcd_write_string_4d(uint8_t theString[])
-{
-    volatile int i = 0;                             // character counter*/
-    while (theString[i] != 0)
-    {
-        lcd_write_character_4d(theString[i]);
-        i++;
-        _delay_us(80);                              // 40 uS delay (min)
-    }
-
-}
-
-/*...........................................................................
-  Name:     lcd_write_character_4d
-  Purpose:  send a byte of information to the LCD data register
-  Entry:    (theData) is the information to be sent to the data register
-  Exit:     no parameters
-  Notes:    does not deal with RW (busy flag is not implemented)
-*/
-
-void lcd_write_character_4d(uint8_t theData)
-{
-    lcd_RS_port |= (1<<lcd_RS_bit);                 // select the Data Register (RS high)
-    lcd_E_port &= ~(1<<lcd_E_bit);                  // make sure E is initially low
-    lcd_write_4(theData);                           // write the upper 4-bits of the data
-    lcd_write_4(theData << 4);                      // write the lower 4-bits of the data
-}
-
-/*...........................................................................
-  Name:     lcd_write_instruction_4d
-  Purpose:  send a byte of information to the LCD instruction register
-  Entry:    (theInstruction) is the information to be sent to the instruction register
-  Exit:     no parameters
-  Notes:    does not deal with RW (busy flag is not implemented)
-*/
-void lcd_write_instruction_4d(uint8_t theInstruction)
-{
-    lcd_RS_port &= ~(1<<lcd_RS_bit);                // select the Instruction Register (RS low)
-    lcd_E_port &= ~(1<<lcd_E_bit);                  // make sure E is initially low
-    lcd_write_4(theInstruction);                    // write the upper 4-bits of the data
-    lcd_write_4(theInstruction << 4);               // write the lower 4-bits of the data
-}
-
-
-/*...........................................................................
-  Name:     lcd_write_4
-  Purpose:  send a byte of information to the LCD module
-  Entry:    (theByte) is the information to be sent to the desired LCD register
-            RS is configured for the desired LCD register
-            E is low
-            RW is low
-  Exit:     no parameters
-  Notes:    use either time delays or the busy flag
-*/
-void lcd_write_4(uint8_t theByte)
-{
-    lcd_D7_port &= ~(1<<lcd_D7_bit);                        // assume that data is '0'
-    if (theByte & 1<<7) lcd_D7_port |= (1<<lcd_D7_bit);     // make data = '1' if necessary
-
-    lcd_D6_port &= ~(1<<lcd_D6_bit);                        // repeat for each data bit
-    if (theByte & 1<<6) lcd_D6_port |= (1<<lcd_D6_bit);
-
-    lcd_D5_port &= ~(1<<lcd_D5_bit);
-    if (theByte & 1<<5) lcd_D5_port |= (1<<lcd_D5_bit);
-
-    lcd_D4_port &= ~(1<<lcd_D4_bit);
-    if (theByte & 1<<4) lcd_D4_port |= (1<<lcd_D4_bit);
-
-// write the data
-                                                    // 'Address set-up time' (40 nS)
-    lcd_E_port |= (1<<lcd_E_bit);                   // Enable pin high
-    _delay_us(1);                                   // implement 'Data set-up time' (80 nS) and 'Enable pulse width' (230 nS)
-    lcd_E_port &= ~(1<<lcd_E_bit);                  // Enable pin low
-    _delay_us(1);                                   // implement 'Data hold time' (10 nS) and 'Enable cycle time' (500 nS)
-}
-
-void countdown(uint8_t czasomierz)
-{
-	while (czasomierz !=0) {
-		temp = czasomierz;
-		lower = temp % 10;
-		temp = temp/10;
-		mid = temp % 10;
-		temp = temp/10;
-		upper = temp % 10;
-		lcd_write_instruction_4d(lcd_Clear);             // clear display RAM
-		_delay_ms(4);
-		switch(upper)
-		{
-			case 0:
-				lcd_write_string_4d(write0);
-			break;
-			case 1:
-				lcd_write_string_4d(write1);
-			break;
-			case 2:
-				lcd_write_string_4d(write2);
-			break;
-				
-			case 3:
-				lcd_write_string_4d(write3);
-			break;
-				
-			case 4:
-				lcd_write_string_4d(write4);
-			break;
-				
-			case 5:
-				lcd_write_string_4d(write5);
-			break;
-				
-			case 6:
-				lcd_write_string_4d(write6);
-			break;
-			
-			case 7:
-				lcd_write_string_4d(write7);
-			break;
-			case 8:
-				lcd_write_string_4d(write8);
-			break;
-			case 9:
-				lcd_write_string_4d(write9);
-			break;
-			default:
-			lcd_write_string_4d(writee);
-		}
-		switch(mid)
-		{
-			case 0:
-			lcd_write_string_4d(write0);
-			break;
-			case 1:
-			lcd_write_string_4d(write1);
-			break;
-			case 2:
-			lcd_write_string_4d(write2);
-			break;
-			
-			case 3:
-			lcd_write_string_4d(write3);
-			break;
-			
-			case 4:
-			lcd_write_string_4d(write4);
-			break;
-			
-			case 5:
-			lcd_write_string_4d(write5);
-			break;
-			
-			case 6:
-			lcd_write_string_4d(write6);
-			break;
-			
-			case 7:
-			lcd_write_string_4d(write7);
-			break;
-			case 8:
-			lcd_write_string_4d(write8);
-			break;
-			case 9:
-			lcd_write_string_4d(write9);
-			break;
-			default:
-			lcd_write_string_4d(writee);
-		}
-		switch(lower)
-		{
-			case 0:
-			lcd_write_string_4d(write0);
-			break;
-			case 1:
-			lcd_write_string_4d(write1);
-			break;
-			case 2:
-			lcd_write_string_4d(write2);
-			break;
-			
-			case 3:
-			lcd_write_string_4d(write3);
-			break;
-			
-			case 4:
-			lcd_write_string_4d(write4);
-			break;
-			
-			case 5:
-			lcd_write_string_4d(write5);
-			break;
-			
-			case 6:
-			lcd_write_string_4d(write6);
-			break;
-			
-			case 7:
-			lcd_write_string_4d(write7);
-			break;
-			case 8:
-			lcd_write_string_4d(write8);
-			break;
-			case 9:
-			lcd_write_string_4d(write9);
-			break;
-			default:
-			lcd_write_string_4d(writee);
-		}
-		czasomierz-=1;
-		_delay_ms(1000);
-	}
-	if (czasomierz == 0) {
-		PORTE = 0x00;
-		czas = 0;
-		lcd_write_instruction_4d(lcd_Clear);             // clear display RAM
-		_delay_ms(4);
-		lcd_write_string_4d(write0);
-		lcd_write_string_4d(write0);
-		lcd_write_string_4d(write0);
-		
-	}
-}
-// Funkcja obslugujaca przerwania
-ISR  (PCINT1_vect)
-{
-	// Przerwanie na przycisk S1:
-	// Odpalenie lub wylaczenie buzzera
-	if (!(PINC & 0x01)){
-		if (PORTE == 0x00){
-			czas = 30;
-			PORTE = 0xff;
-			lcd_write_instruction_4d(lcd_Clear);             // clear display RAM
-			_delay_ms(4);
-			lcd_write_string_4d(write0);
-			lcd_write_string_4d(write3);
-			lcd_write_string_4d(write0);
-		}
-		else {
-			countdown(czas);
-		}
-	}
-	
-	//Przerwanie na przycisk S2:
-	//Zwiekszenie czasu o 1
-	if (!(PINC & 0x02)){
-				czas+=1;
-				temp = czas;
-				lower = temp % 10;
-				temp = temp/10;
-				mid = temp % 10;
-				temp = temp/10;
-				upper = temp % 10;
-				lcd_write_instruction_4d(lcd_Clear);             // clear display RAM
-				_delay_ms(4);
-				switch(upper)
-				{
-					case 0:
-					lcd_write_string_4d(write0);
-					break;
-					case 1:
-					lcd_write_string_4d(write1);
-					break;
-					case 2:
-					lcd_write_string_4d(write2);
-					break;
-					
-					case 3:
-					lcd_write_string_4d(write3);
-					break;
-					
-					case 4:
-					lcd_write_string_4d(write4);
-					break;
-					
-					case 5:
-					lcd_write_string_4d(write5);
-					break;
-					
-					case 6:
-					lcd_write_string_4d(write6);
-					break;
-					
-					case 7:
-					lcd_write_string_4d(write7);
-					break;
-					case 8:
-					lcd_write_string_4d(write8);
-					break;
-					case 9:
-					lcd_write_string_4d(write9);
-					break;
-					default:
-					lcd_write_string_4d(writee);
-				}
-				switch(mid)
-				{
-					case 0:
-					lcd_write_string_4d(write0);
-					break;
-					case 1:
-					lcd_write_string_4d(write1);
-					break;
-					case 2:
-					lcd_write_string_4d(write2);
-					break;
-					
-					case 3:
-					lcd_write_string_4d(write3);
-					break;
-					
-					case 4:
-					lcd_write_string_4d(write4);
-					break;
-					
-					case 5:
-					lcd_write_string_4d(write5);
-					break;
-					
-					case 6:
-					lcd_write_string_4d(write6);
-					break;
-					
-					case 7:
-					lcd_write_string_4d(write7);
-					break;
-					case 8:
-					lcd_write_string_4d(write8);
-					break;
-					case 9:
-					lcd_write_string_4d(write9);
-					break;
-					default:
-					lcd_write_string_4d(writee);
-				}
-				switch(lower)
-				{
-					case 0:
-					lcd_write_string_4d(write0);
-					break;
-					case 1:
-					lcd_write_string_4d(write1);
-					break;
-					case 2:
-					lcd_write_string_4d(write2);
-					break;
-					
-					case 3:
-					lcd_write_string_4d(write3);
-					break;
-					
-					case 4:
-					lcd_write_string_4d(write4);
-					break;
-					
-					case 5:
-					lcd_write_string_4d(write5);
-					break;
-					
-					case 6:
-					lcd_write_string_4d(write6);
-					break;
-					
-					case 7:
-					lcd_write_string_4d(write7);
-					break;
-					case 8:
-					lcd_write_string_4d(write8);
-					break;
-					case 9:
-					lcd_write_string_4d(write9);
-					break;
-					default:
-					lcd_write_string_4d(writee);
-			}
-			}
-	// Przerwanie na przycisk S4:
-	//Drzemeczka
-	else if (!(PINC & 0x08)){
-		if (PORTE == 0x00){
-			czas=15;
-			PORTE = 0xff;
-			countdown(czas);
-		}
-	}
-	//Przerwanie na przycisk S3:
-	// Zmniejszenie czasu o 1
-	else if (!(PINC & 0x04))
-	{
-			czas-=1;
-			temp = czas;
-			lower = temp % 10;
-			temp = temp/10;
-			mid = temp % 10;
-			temp = temp/10;
-			upper = temp % 10;
-			
-			lcd_write_instruction_4d(lcd_Clear);             // clear display RAM
-			_delay_ms(4);
-			switch(upper)
-			{
-				case 0:
-				lcd_write_string_4d(write0);
-				break;
-				case 1:
-				lcd_write_string_4d(write1);
-				break;
-				case 2:
-				lcd_write_string_4d(write2);
-				break;
-				
-				case 3:
-				lcd_write_string_4d(write3);
-				break;
-				
-				case 4:
-				lcd_write_string_4d(write4);
-				break;
-				
-				case 5:
-				lcd_write_string_4d(write5);
-				break;
-				
-				case 6:
-				lcd_write_string_4d(write6);
-				break;
-				
-				case 7:
-				lcd_write_string_4d(write7);
-				break;
-				case 8:
-				lcd_write_string_4d(write8);
-				break;
-				case 9:
-				lcd_write_string_4d(write9);
-				break;
-				default:
-				lcd_write_string_4d(writee);
-			}
-			switch(mid)
-			{
-				case 0:
-				lcd_write_string_4d(write0);
-				break;
-				case 1:
-				lcd_write_string_4d(write1);
-				break;
-				case 2:
-				lcd_write_string_4d(write2);
-				break;
-				
-				case 3:
-				lcd_write_string_4d(write3);
-				break;
-				
-				case 4:
-				lcd_write_string_4d(write4);
-				break;
-				
-				case 5:
-				lcd_write_string_4d(write5);
-				break;
-				
-				case 6:
-				lcd_write_string_4d(write6);
-				break;
-				
-				case 7:
-				lcd_write_string_4d(write7);
-				break;
-				case 8:
-				lcd_write_string_4d(write8);
-				break;
-				case 9:
-				lcd_write_string_4d(write9);
-				break;
-				default:
-				lcd_write_string_4d(writee);
-			}
-			switch(lower)
-			{
-				case 0:
-				lcd_write_string_4d(write0);
-				break;
-				case 1:
-				lcd_write_string_4d(write1);
-				break;
-				case 2:
-				lcd_write_string_4d(write2);
-				break;
-				
-				case 3:
-				lcd_write_string_4d(write3);
-				break;
-				
-				case 4:
-				lcd_write_string_4d(write4);
-				break;
-				
-				case 5:
-				lcd_write_string_4d(write5);
-				break;
-				
-				case 6:
-				lcd_write_string_4d(write6);
-				break;
-				
-				case 7:
-				lcd_write_string_4d(write7);
-				break;
-				case 8:
-				lcd_write_string_4d(write8);
-				break;
-				case 9:
-				lcd_write_string_4d(write9);
-				break;
-				default:
-				lcd_write_string_4d(writee);
-			}
-	}
-	// Opoznienie
-	_delay_ms(300);
-}
-/******************************* Main Program Code *************************/
-int main(void)
-{
-	DDRE=0xff; //Set port E as output
-	DDRC=0x00; //Set port C as input
-	PORTC=0xff; //Set pull-ups on port C
-	PORTE=0xff; //set port E as 1
-	// configure the microprocessor pins for the data lines
-	lcd_D7_ddr |= (1<<lcd_D7_bit);                  // 4 data lines - output
-	lcd_D6_ddr |= (1<<lcd_D6_bit);
-	lcd_D5_ddr |= (1<<lcd_D5_bit);
-	lcd_D4_ddr |= (1<<lcd_D4_bit);
-
-	// configure the microprocessor pins for the control lines
-	lcd_E_ddr |= (1<<lcd_E_bit);                    // E line - output
-	lcd_RS_ddr |= (1<<lcd_RS_bit);                  // RS line - output
-
-	// initialize the LCD controller as determined by the defines (LCD instructions)
-	lcd_init_4d();                                  // initialize the LCD display for a 4-bit interface
-
-	// display the first line of information
-	lcd_write_string_4d(write30);
-	
-
-// Wlaczenie przerwan
-PCICR |= (1 << PCIE1);		// Wlaczenie przerwan zewnetrznych
-PCMSK1 |= (1 << PCINT8);	// Przycisk S1
-PCMSK1 |= (1 << PCINT9);	// Przycisk S2
-PCMSK1 |= (1 << PCINT10);	// Przycisk S3
-PCMSK1 |= (1 << PCINT11);	// Przycisk S4
- cli();
- sei();
-    while(1){
-		sleep_enable();
-		sleep_cpu();
-  }
-    return 0;
-}
-
-
-
-
-
-
-
-
-
-
+// Countdown time source
+//   By default the seconds are counted by Timer1 from the 16 MHz crystal, and the wall clock
+//   keeps that tick running all the time, so the CPU can only idle.  Uncomment tick_rtc to
+//   count them with Timer2 from a 32.768 kHz watch crystal instead and spend the time between
+//   seconds and button presses in power-save.  TOSC1/TOSC2 share the XTAL pins, so the CPU
+//   then runs from the internal 8 MHz RC oscillator.
+//
+//   Estimated average supply current of the microcontroller alone, from datasheet typicals
+//   (16 MHz at 5 V, 8 MHz RC at 3 V) and a duty cycle per second of ~40 uS of CPU time plus
+//   ~100 uS of idle while TIMER0_COMPA sends two bytes to the LCD:
+//     busy-wait build (_delay_ms loop, always active)      ~ 9 mA
+//     Timer1 tick, idle between ticks                      ~ 2.7 mA
+//     tick_rtc, power-save between ticks                   ~ 1.2 uA
+//     tick_wdt, power-down between ticks (see below)      ~ 14 uA
+//   This is also the current with no countdown running: the tick counts the time of day, so
+//   the Timer1 build never gets below idle.
+//#define tick_rtc
+//
+//   Boards without the watch crystal can uncomment tick_wdt instead: the watchdog interrupt
+//   then wakes the CPU from power-down every wdt_period_s seconds and the 16 MHz crystal only
+//   runs while there is work.  The 128 kHz watchdog oscillator may be 10% off, so its period
+//   is timed against Timer1 every wdt_calibrate_s seconds and the seconds are counted from
+//   that measurement.  The residual drift is what the oscillator wanders between two
+//   calibrations (serial command O shows the last change) plus 64 ppm of timing resolution -
+//   estimated at 0.1 - 0.5% with a stable supply and temperature, against ~0.2% slow for
+//   the busy-wait build, which added the LCD writes to every _delay_ms(1000).  The current
+//   is ~5 uA for the watchdog in power-down plus ~9 uA for the two seconds of idle spent on
+//   each calibration; with wdt_period_s 8 the display only changes every 8 seconds.
+//#define tick_wdt
+#if defined(tick_rtc) && defined(tick_wdt)
+#error "choose one of tick_rtc and tick_wdt"
+#endif
+#ifdef tick_rtc
+#define F_CPU 8000000UL
+#else
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+// Hardware access layer
+//   The LCD driver, the buttons and the alarm output reach the I/O pins and wait only through
+//   these macros, and the EEPROM read and write strobes go through them too.  The host build
+//   (host/hal.h, make host) supplies its own definitions before this point and runs the same
+//   code against simulated peripherals and an HD44780 model.
+#ifndef hal_read
+#define hal_read(reg)               (reg)
+#define hal_write(reg, value)       ((reg) = (value))
+#define hal_delay_us(t)             _delay_us(t)
+#define hal_delay_ms(t)             _delay_ms(t)
+#endif
+#define hal_set_bits(reg, mask)     hal_write(reg, hal_read(reg) | (mask))
+#define hal_clear_bits(reg, mask)   hal_write(reg, hal_read(reg) & ~(mask))
+
+
+// LCD interface
+//   make sure that the LCD RW pin is connected to GND, unless lcd_use_busy_flag is defined
+#define lcd_D7_port     PORTD                   // lcd D7 connection
+#define lcd_D7_bit      PORTD7
+#define lcd_D7_ddr      DDRD
+#define lcd_D7_pin      PIND
+
+#define lcd_D6_port     PORTD                   // lcd D6 connection
+#define lcd_D6_bit      PORTD6
+#define lcd_D6_ddr      DDRD
+#define lcd_D6_pin      PIND
+
+#define lcd_D5_port     PORTD                   // lcd D5 connection
+#define lcd_D5_bit      PORTD5
+#define lcd_D5_ddr      DDRD
+#define lcd_D5_pin      PIND
+
+#define lcd_D4_port     PORTD                   // lcd D4 connection
+#define lcd_D4_bit      PORTD4
+#define lcd_D4_ddr      DDRD
+#define lcd_D4_pin      PIND
+
+// Optional I2C backpack - uncomment lcd_i2c when the LCD sits behind a PCF8574 port expander
+//   (P0 = RS, P1 = RW, P2 = E, P3 = backlight, P4..P7 = D4..D7) on SDA0 = PC4 / SCL0 = PC5
+//   instead of the pins above and below.  RS and E then live in lcd_i2c_ctrl, lcd_write_4
+//   only records the two expander bytes of one E strobe, and each instruction or character
+//   goes out as a single TWI burst (address + 4 bytes, 5 when RS changes) sent by TWI0_vect
+//   from lcd_i2c_buf, so TIMER0_COMPA never waits for the bus.
+//#define lcd_i2c
+#define lcd_i2c_address 0x27                    // 7-bit address (0x3F for a PCF8574A)
+#define lcd_i2c_Hz      100000UL                // PCF8574 maximum - most backpacks also run at 400 kHz
+#define lcd_i2c_RS      0x01                    // expander bits
+#define lcd_i2c_E       0x04
+#define lcd_i2c_Light   0x08
+#define lcd_i2c_burst_us (7 * 9 * 1000000UL / lcd_i2c_Hz)  // start, address, 5 bytes, stop
+
+#ifdef lcd_i2c
+#define lcd_E_port      lcd_i2c_ctrl            // lcd Enable - expander P2
+#define lcd_E_bit       2
+#define lcd_RS_port     lcd_i2c_ctrl            // lcd Register Select - expander P0
+#define lcd_RS_bit      0
+#define lcd_i2c_busy()  (TWCR0 & (1<<TWIE))     // a burst is still on the bus
+#else
+#define lcd_E_port      PORTB                   // lcd Enable pin
+#define lcd_E_bit       PORTB1
+#define lcd_E_ddr       DDRB
+
+#define lcd_RS_port     PORTB                   // lcd Register Select pin
+#define lcd_RS_bit      PORTB0
+#define lcd_RS_ddr      DDRB
+#define lcd_i2c_busy()  0
+#endif
+
+// When D4..D7 are consecutive bits of one port (as on this board) lcd_write_4 replaces the
+//   four per-bit read-modify-write sequences with a single masked port write.  The bit test
+//   is done by the preprocessor; the port test compares register addresses, which the
+//   compiler folds to a constant, so only one of the two paths is compiled in.
+#if (lcd_D5_bit == lcd_D4_bit + 1) && (lcd_D6_bit == lcd_D4_bit + 2) && (lcd_D7_bit == lcd_D4_bit + 3)
+#define lcd_data_consecutive    1
+#else
+#define lcd_data_consecutive    0
+#endif
+#define lcd_data_same_port  ((&lcd_D5_port == &lcd_D4_port) && (&lcd_D6_port == &lcd_D4_port) && \
+                             (&lcd_D7_port == &lcd_D4_port))
+#define lcd_data_nibble     (lcd_data_consecutive && lcd_data_same_port)
+#define lcd_data_mask       (0x0F << lcd_D4_bit)    // D4..D7 within the port (nibble wiring only)
+
+// Optional RW connection - uncomment lcd_use_busy_flag to wait on the busy flag instead of
+//   the worst-case execution times (RW must then be wired to lcd_RW_bit instead of GND)
+//#define lcd_use_busy_flag
+#define lcd_RW_port     PORTB                   // lcd Read/Write pin
+#define lcd_RW_bit      PORTB3
+#define lcd_RW_ddr      DDRB
+#define lcd_busy_timeout (2 * lcd_tx_slow_counts)   // status reads, one Timer0 count apart, before
+                                                //   falling back to the Clear / Home delay
+
+#if defined(lcd_use_busy_flag) && defined(lcd_i2c)
+#error "the busy flag cannot be read through the I2C backpack"
+#endif
+
+// LCD module information
+#define lcd_LineOne     0x00                    // start of line 1
+#define lcd_LineTwo     0x40                    // start of line 2
+//#define   lcd_LineThree   0x14                  // start of line 3 (20x4)
+//#define   lcd_lineFour    0x54                  // start of line 4 (20x4)
+//#define   lcd_LineThree   0x10                  // start of line 3 (16x4)
+//#define   lcd_lineFour    0x50                  // start of line 4 (16x4)
+
+#define lcd_Columns     16                      // characters per line
+#define lcd_Cells       32                      // characters on the whole display (2x16)
+#define lcd_cell_address(c) (((c) < lcd_Columns) ? lcd_LineOne + (c) : lcd_LineTwo + (c) - lcd_Columns)
+
+// LCD instructions
+#define lcd_Clear           0b00000001          // replace all characters with ASCII 'space'
+#define lcd_Home            0b00000010          // return cursor to first position on first line
+#define lcd_EntryMode       0b00000110          // shift cursor from left to right on read/write
+#define lcd_DisplayOff      0b00001000          // turn display off
+#define lcd_DisplayOn       0b00001100          // display on, cursor off, don't blink character
+#define lcd_FunctionReset   0b00110000          // reset the LCD
+#define lcd_FunctionSet4bit 0b00101000          // 4-bit data, 2-line display, 5 x 7 font
+#define lcd_SetCursor       0b10000000          // set cursor position
+#define lcd_SetCGRAM        0b01000000          // set CGRAM address (custom character slot * 8 + row)
+
+// Large digits - each digit is 3 cells wide on both lines, drawn with custom characters from
+//   glyph_table.  The HD44780 has 8 CGRAM slots; a small cache remembers which glyph each slot
+//   holds and uploads (8 bus writes) only a glyph that is missing.  Comment out lcd_big_digits
+//   for the original one-line layout.
+#define lcd_big_digits
+#define lcd_cgram_slots     8
+#define lcd_cgram_char(s)   (0x08 + (s))        // 0x08 - 0x0F show CGRAM 0 - 7 and never end a string
+#define lcd_cgram_empty     0xFF
+#define big_Width           4                   // cells per digit, including the gap after it
+#define glyph_LT            0                   // glyph_table indices
+#define glyph_UB            1
+#define glyph_RT            2
+#define glyph_LL            3
+#define glyph_LB            4
+#define glyph_LR            5
+#define glyph_UMB           6
+#define glyph_LMB           7
+#define glyph_Full          0xFF                // built-in character codes used as they are
+#define glyph_Blank         ' '
+
+// Asynchronous LCD transmit queue (Timer0, CTC mode, TOP = OCR0A)
+#define lcd_tx_queue_size   64                      // must be a power of two
+#define lcd_tx_RS           0x01                    // byte goes to the Data Register
+#define lcd_tx_Slow         0x02                    // Clear or Home - 1.64 mS execution time
+#define lcd_tx_Nibble       0x04                    // reset sequence - send the upper nibble only
+#define lcd_tx_Pause        0x08                    // send nothing, wait (byte) milliseconds
+#define lcd_tx_InitDone     0x10                    // with lcd_tx_Pause: the reset sequence has been executed
+#define lcd_tx_clock_select (1<<CS02)               // Timer0 clock = F_CPU / 256
+#define lcd_tx_clock_mask   ((1<<CS02)|(1<<CS01)|(1<<CS00))
+#define lcd_tx_us_per_count (256UL * 1000000UL / F_CPU)
+#define lcd_tx_counts(us)   (((us) + lcd_tx_us_per_count - 1) / lcd_tx_us_per_count)
+#define lcd_tx_fast_counts  lcd_tx_counts(40)       // 40 uS (min) after most instructions and data
+#ifdef lcd_i2c                                      // E falls only at the end of the burst
+#define lcd_tx_slow_counts  lcd_tx_counts(1640 + lcd_i2c_burst_us)
+#else
+#define lcd_tx_slow_counts  lcd_tx_counts(1640)     // 1.64 mS (min) after Clear and Home
+#endif
+#define lcd_tx_ms_counts    lcd_tx_counts(1000)     // one step of an lcd_tx_Pause
+#define lcd_power_up_ms     100                     // 40 mS (min) after Vcc reaches 4.5 V
+#define lcd_reset_ms        5                       // 4.1 mS (min) after the first FunctionReset
+
+#define lcd_tx_busy()       (TCCR0B & lcd_tx_clock_mask)
+
+// Countdown time base (Timer1, CTC mode, TOP = OCR1A - or Timer2 with tick_rtc)
+#define tick_prescaler      256UL                   // Timer1 clock = F_CPU / 256 = 62.5 kHz
+#define tick_clock_select   (1<<CS12)               // CS1[2:0] value for tick_prescaler
+#define tick_clock_mask     ((1<<CS12)|(1<<CS11)|(1<<CS10))
+#define tick_Hz             1UL                     // one compare match per second
+#define tick_OCR            (F_CPU / tick_prescaler / tick_Hz - 1)
+
+// Error of the tick period against F_CPU in ppm (1 ppm = 3.6 mS per hour).
+//   16 MHz / 256 / 62500 is exact, so the countdown only drifts as much as the crystal does.
+#define tick_period_clocks  ((tick_OCR + 1) * tick_prescaler * tick_Hz)
+#define tick_error_ppm      (((tick_period_clocks > F_CPU) ? (tick_period_clocks - F_CPU) \
+                                                           : (F_CPU - tick_period_clocks)) * 1000000UL / F_CPU)
+#define tick_max_error_ppm  10                      // 36 mS per hour
+
+// Timer2 from the 32.768 kHz crystal: 32768 / 128 = 256 Hz, so the 8-bit counter overflows
+//   exactly once per second
+#define rtc_clock_select    ((1<<CS22)|(1<<CS20))   // Timer2 clock = TOSC / 128
+#define rtc_busy_mask       ((1<<TCN2UB)|(1<<OCR2AUB)|(1<<OCR2BUB)|(1<<TCR2AUB)|(1<<TCR2BUB))
+
+// Watchdog tick (tick_wdt): WDT_vect adds the calibrated length of each watchdog period, in
+//   Timer1 counts at F_CPU / 1024, to wdt_phase and ticks one second per wdt_second_counts.
+//   A calibration keeps the CPU in idle for one period, so the crystal is already running,
+//   and then times the next period from one WDT_vect to the next - equal wake-up latencies
+//   at both ends cancel.
+#define wdt_period_s        1                       // 1 or 8 seconds between wake-ups
+#if wdt_period_s == 8
+#define wdt_prescale        ((1<<WDP3)|(1<<WDP0))   // 1024K cycles of the 128 kHz oscillator
+#else
+#define wdt_prescale        ((1<<WDP2)|(1<<WDP1))   // 128K cycles
+#endif
+#define wdt_clock_select    ((1<<CS12)|(1<<CS10))   // Timer1 clock = F_CPU / 1024 = 15625 Hz
+#define wdt_second_counts   (F_CPU / 1024)
+#define wdt_calibrate_s     600                     // seconds between calibrations
+#define wdt_cal_Armed       0x01                    // staying in idle until the next period starts
+#define wdt_cal_Timing      0x02                    // Timer1 is timing this period
+
+// Events passed from the interrupt handlers to main()
+#define ev_None             0x00                    // queue empty
+#define ev_Buttons          0x10                    // low nibble = buttons pressed or repeated (bit 0 = S1 ... bit 3 = S4)
+#define ev_Tick             0x20                    // one second has elapsed
+#define ev_Done             0x30                    // the countdown has reached zero
+#define ev_LcdIdle          0x40                    // everything queued for the LCD has been executed
+#define ev_ClockAlarm       0x50                    // the wall clock has reached the next calendar alarm
+#define ev_NewDay           0x60                    // the wall clock has passed midnight
+#define ev_Released         0x70                    // low nibble = buttons released
+#define ev_LongPress        0x80                    // low nibble = buttons held for buttons_long_samples
+#define ev_Command          0x90                    // a complete line is waiting in uart_rx
+#define ev_TypeMask         0xF0
+#define ev_queue_size       16                      // must be a power of two
+
+// Cooperative scheduler - main() runs the tasks of sched_tasks (a fixed table in flash) to
+//   completion, lowest number first, whenever their bit is set in sched_ready.  The interrupt
+//   handlers post work with event_put (which readies task_Events) or sched_post, and a task may
+//   ask to run again later with sched_after.  Deadlines are kept in tick timer counts (Timer1,
+//   or Timer2 with tick_rtc) since reset.  With nothing ready sched_run programs compare B of
+//   the tick timer for the earliest deadline of the current second and sleeps, so the CPU
+//   wakes only for due work, interrupts and the seconds tick - never on a polling period.
+#define task_Events         0                       // drain the event queue
+#define task_Second         1                       // redraw and bookkeeping once per second
+#define task_Status         2                       // periodic status line (command M)
+#define sched_task_count    3                       // at most 8 - one bit of sched_ready each
+#ifdef tick_rtc
+#define sched_period        256UL                   // Timer2 counts per second (3.9 mS)
+#define sched_count()       TCNT2
+#define sched_tick_pending() (TIFR2 & (1<<TOV2))
+#elif defined(tick_wdt)
+#define sched_period        1UL                     // whole seconds - no clock runs between wake-ups
+#define sched_count()       0
+#define sched_tick_pending() 0
+#else
+#define sched_period        (tick_OCR + 1)          // Timer1 counts per second (16 uS)
+#define sched_count()       TCNT1
+#define sched_tick_pending() (TIFR1 & (1<<OCF1A))
+#endif
+#define sched_ms(t)         ((uint32_t)(t) * sched_period / 1000)   // (t) up to 65535 mS
+#define sched_seconds(t)    ((uint32_t)(t) * sched_period)
+#ifdef tick_wdt
+#define sched_margin        0                       // deadlines are met at the first tick on or after them
+#else
+#define sched_margin        4                       // closer deadlines run now - a compare this near could be missed
+#endif
+// The overhead of a dispatch is stamped with Timer1 at F_CPU / 256 (it runs free with tick_rtc;
+//   with tick_wdt it runs only to calibrate, so the overhead reads 0)
+#define sched_stamp_us      (256000000UL / F_CPU)   // 16 uS, 32 uS with tick_rtc
+#if defined(tick_rtc) || defined(tick_wdt)
+#define sched_stamp_gap     0                       // Timer1 wraps at 65536
+#else
+#define sched_stamp_gap     (65536UL - (tick_OCR + 1))  // CTC skips these counts
+#endif
+
+#define buttons_mask        0x0F                    // S1..S4 on PINC0..PINC3
+
+// Button sampler (Timer3, CTC mode, TOP = OCR3A) - started by the first pin change and
+//   stopped once every button is released, so it costs nothing while the buttons are idle.
+//   A two-bit vertical counter per button accepts a new level after 4 equal samples (32 mS).
+#define buttons_sample_Hz   125UL                   // one sample every 8 mS
+#define buttons_prescaler   64UL
+#define buttons_clock_select ((1<<CS31)|(1<<CS30))  // Timer3 clock = F_CPU / 64
+#define buttons_clock_mask  ((1<<CS32)|(1<<CS31)|(1<<CS30))
+#define buttons_OCR         (F_CPU / buttons_prescaler / buttons_sample_Hz - 1)
+#define buttons_sampling()  (TCCR3B & buttons_clock_mask)
+#define buttons_repeat_mask 0x06                    // S2 and S3 repeat while held, the others long-press
+#define buttons_long_samples 125                    // 1 S held -> ev_LongPress
+#define buttons_repeat_first 63                     // 0.5 S held -> first repeat
+#define buttons_repeat_start 25                     // 200 mS between the first repeats ...
+#define buttons_repeat_min  5                       // ... shrinking by a quarter each time to 40 mS
+
+// Optional ISR timing probe: uncomment isr_probe to hold a spare pin high while a handler
+//   runs and measure the pulse width with a scope or logic analyser
+//#define isr_probe
+#define isr_probe_port      PORTB
+#define isr_probe_bit       PORTB2
+#define isr_probe_ddr       DDRB
+#ifdef isr_probe
+#define probe_on()          hal_set_bits(isr_probe_port, 1<<isr_probe_bit)
+#define probe_off()         hal_clear_bits(isr_probe_port, 1<<isr_probe_bit)
+#else
+#define probe_on()
+#define probe_off()
+#endif
+
+// Optional simavr benchmark markers: define simavr_bench (with simavr's simavr/sim directory on
+//   the include path) to embed trace metadata in the ELF file.  simavr then writes bench.vcd
+//   with the markers below, the buttons and the LCD lines, time-stamped to the CPU cycle, so
+//   button-to-LCD latency, redraw time, lcd_init_4d time and wake-up cost can be read off it.
+//   GPIOR0 marks the interrupt handlers, GPIOR1 the longer sections started by main() and
+//   GPIOR2 the sleep state, so no marker overwrites another; a handler ends with bench_None.
+//   The sections of GPIOR1 can overlap (a frame queued behind the reset sequence), so each
+//   has a bit of its own, set by bench_main_begin and cleared by bench_main_end.
+#define bench_None          0x00
+#define bench_LcdInit       0x01                    // GPIOR1: lcd_init_4d sequence not yet executed
+#define bench_Redraw        0x02                    // GPIOR1: frame queued, not yet on the display
+#define bench_End           0x80                    // trace_Main: the section in the other bits ended
+#define bench_Sleep         0x01                    // GPIOR2: CPU asleep (cleared on wake-up)
+#define bench_ButtonIsr     0x10                    // GPIOR0: PCINT1 handler running
+#define bench_TickIsr       0x11                    // GPIOR0: TIMER1_COMPA handler running
+#define bench_LcdByte       0x12                    // GPIOR0: TIMER0_COMPA sending a byte to the LCD
+#define bench_SampleIsr     0x13                    // GPIOR0: TIMER3_COMPA sampling the buttons
+#define bench_BuzzerIsr     0x14                    // GPIOR0: TIMER4_OVF computing a buzzer sample
+#define bench_EepromIsr     0x15                    // GPIOR0: EE_READY writing a settings byte
+#define bench_UartIsr       0x16                    // GPIOR0: USART0 receiving or sending a byte
+#ifdef simavr_bench
+#include "avr_mcu_section.h"
+AVR_MCU(F_CPU, "atmega328pb");
+AVR_MCU_VCD_FILE("bench.vcd", 1000);
+const struct avr_mmcu_vcd_trace_t bench_trace[] _MMCU_ = {
+    { AVR_MCU_VCD_SYMBOL("ISR_MARK"), .what = (void*)&GPIOR0, },
+    { AVR_MCU_VCD_SYMBOL("MAIN_MARK"), .what = (void*)&GPIOR1, },
+    { AVR_MCU_VCD_SYMBOL("SLEEP"), .what = (void*)&GPIOR2, },
+    { AVR_MCU_VCD_SYMBOL("BUTTONS"), .mask = 0x0F, .what = (void*)&PINC, },
+    { AVR_MCU_VCD_SYMBOL("LCD_DATA"), .mask = 0xF0, .what = (void*)&PORTD, },
+    { AVR_MCU_VCD_SYMBOL("LCD_RS_E"), .mask = 0x03, .what = (void*)&PORTB, },
+};
+#define bench_isr(m)        (GPIOR0 = (m))
+#define bench_main_begin(m) ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { GPIOR1 |= (m); }  // not an sbi address
+#define bench_main_end(m)   (GPIOR1 &= ~(m))        // from TIMER0_COMPA only - interrupts are off
+#define bench_sleep(m)      (GPIOR2 = (m))
+#elif defined(trace_buffer)
+#define bench_isr(m)        trace(trace_Isr, m)
+#define bench_main_begin(m) trace(trace_Main, m)
+#define bench_main_end(m)   trace(trace_Main, (m) | bench_End)
+#define bench_sleep(m)      trace(trace_Sleep, m)
+#else
+#define bench_isr(m)
+#define bench_main_begin(m)
+#define bench_main_end(m)   ((void)0)
+#define bench_sleep(m)
+#endif
+
+// Optional trace buffer: define trace_buffer to record the bench markers above, every posted
+//   event and every LCD instruction, with a timestamp, in a circular buffer in SRAM.  The
+//   serial command L dumps it, oldest first, as "L <code> <data> <time>" lines (all hex);
+//   tools/trace_decode.py turns them into a timeline and a histogram of PCINT1 entry to the
+//   ev_LcdIdle that ends the redraw.
+//   The time is TCNT1 - 16 uS counts wrapping at 62500 with the Timer1 tick, 32 uS counts
+//   wrapping at 65536 with tick_rtc (Timer1 then runs free, and stops in power-save).
+//   With tick_wdt Timer1 runs only while the watchdog is calibrated, so the times are 0.
+//   With simavr_bench the markers go to the GPIOR registers instead.
+#define trace_size          128                     // records (4 bytes each), a power of two up to 128 - one
+                                                    //   press from PCINT1 to ev_LcdIdle takes about 40
+#define trace_Isr           0x01                    // data = bench_ code of the handler, bench_None on exit
+#define trace_Main          0x02                    // data = bench_ code of the section, with bench_End at its end
+#define trace_Sleep         0x03                    // data = bench_Sleep going to sleep, bench_None on wake-up
+#define trace_Event         0x04                    // data = ev_ code posted
+#define trace_LcdInstr      0x05                    // data = instruction sent to the LCD
+#ifdef trace_buffer
+#define trace(c, d)         trace_put(c, d)
+#else
+#define trace(c, d)         ((void)0)
+#endif
+
+// Times are held as three packed BCD digits (0x000 - 0x999 seconds) so that they can be
+//   counted and displayed without division, which the AVR does not have in hardware
+#define bcd_char(d)         pgm_read_byte(&bcd_ascii[(d) & 0x0F])
+#define time_default        0x030                   // alarm time while the EEPROM holds no settings
+#define time_snooze         0x015                   // S4 - snooze
+
+// Alarm scheduler - a fixed pool of alarms kept in a binary min-heap ordered by expiry time,
+//   so each tick only compares the earliest expiry with the clock, however many are armed
+#ifndef alarm_count
+#define alarm_count         8                       // statically allocated alarms (at most 255)
+#endif
+#define alarm_ui            0                       // the alarm set and shown on the front panel
+#define alarm_ui_output     0xFF                    // PORTE bits it pulls low when it fires (all, as before)
+#define alarm_Armed         0x01                    // counting down, present in alarm_heap
+#define alarm_Ringing       0x02                    // fired, its output bits are low
+#define alarm_before(a, b)  ((int16_t)(alarms[a].expiry - alarms[b].expiry) < 0)
+
+// Buzzer (Timer4, 8-bit fast PWM on OC4B = PD2) - a direct digital synthesis engine: every
+//   PWM period the overflow interrupt adds the note's step to a 16-bit phase accumulator and
+//   loads the sine table entry it points at into OCR4B.  An RC low-pass on PD2 (or the piezo
+//   itself) removes the PWM carrier.  The lowest-numbered ringing alarm plays its melody.
+#define buzzer_port         PORTD
+#define buzzer_bit          PORTD2
+#define buzzer_ddr          DDRD
+#define buzzer_prescaler    8UL
+#define buzzer_clock_select (1<<CS41)               // Timer4 clock = F_CPU / 8
+#define buzzer_clock_mask   ((1<<CS42)|(1<<CS41)|(1<<CS40))
+#define buzzer_sample_Hz    (F_CPU / buzzer_prescaler / 256)    // 7812 Hz (3906 Hz with tick_rtc)
+#define buzzer_step(f)      ((uint16_t)((f) * 65536UL / buzzer_sample_Hz))
+#define buzzer_seq_div      (buzzer_sample_Hz / 32) // samples per melody time unit (1/32 S)
+#define buzzer_playing()    (TCCR4B & buzzer_clock_mask)
+#define melody_Beep         0                       // melodies[] indices
+#define melody_Double       1
+#define melody_Rise         2
+#define melody_None         0xFF
+
+// Settings store - a ring log of fixed-size records spread over the whole EEPROM.  Each save
+//   goes to the slot after the newest one, so the writes rotate through every cell (100 000
+//   cycles each, ~12.8 million saves in all); a sequence number finds the newest record and a
+//   CRC rejects one torn by a reset.  Saves are deferred until the settings have been left
+//   alone for settings_delay_s seconds, so holding S2 costs one record, not one per step.
+#define settings_slots      ((E2END + 1) / sizeof(struct settings))
+#define settings_delay_s    3
+#define settings_seq_erased 0xFFFF                  // never written - blank EEPROM reads as 0xFF
+#define settings_writing()  (EECR & (1<<EERIE))
+
+// Serial interface (USART0, RXD = PD0, TXD = PD1, 38400 8N1) - ASCII lines ending in CR or LF,
+//   numbers in hex, times and dates in packed BCD (so they read as decimal):
+//     ?                   status: S <czas> <left> <I|R|A> <hhmmss>
+//     C ddd               set the countdown time       G   start it        X   stop / silence
+//     P a ddd oo          arm pool alarm a (not 0, the countdown's) for ddd seconds, outputs oo
+//     X a                 stop pool alarm a, or silence it if it rings
+//     T hhmmss            set the time of day          D yymmddw   set the date (w: 0 = Monday)
+//     A n hhmm ww a oo    calendar alarm n at hh:mm on weekdays ww, pool alarm a, outputs oo
+//     R a                 ring pool alarm a (test)     B a m   melody m for pool alarm a
+//     N                   counters: N <events dropped> <LCD writes> <bytes dropped> <CGRAM uploads>
+//     M ss                send the status every ss seconds, 00 = off
+//     L                   dump the trace buffer (only with trace_buffer)
+//     K                   stack: K <bytes never used since reset>
+//     W                   scheduler: W <wake-ups/s> <tasks run/s> <uS per dispatch> - restarts the average
+//     O                   watchdog: O <Timer1 counts per period> <change at the last calibration>
+//                         (only with tick_wdt, counts at F_CPU / 1024)
+//   each command is answered with its reply line, OK or ERR - ERR also for a digit that is
+//   not BCD where BCD is expected, a time or date that does not exist, or a weekday w that
+//   is not the one of the date.  Receiving needs the I/O clock,
+//   so in power-save a falling edge on RXD (PCINT16) wakes the CPU - the first byte of a
+//   burst may be lost, a host should start with a spare CR - and it then idles for
+//   uart_awake_s seconds after the last byte.
+#define uart_baud           38400UL
+#define uart_UBRR           (F_CPU / 8 / uart_baud - 1)     // U2X: 0.2 % error at 16 and 8 MHz
+#define uart_rx_size        32                      // must be a power of two
+#define uart_tx_size        64                      // must be a power of two
+#define uart_line_size      24
+#define uart_awake_s        3
+
+// Stack check - the RAM between the end of .bss and the top of the stack is filled with
+//   stack_paint before main() starts; the bytes still holding it are the stack that has never
+//   been used (serial command K).  The handlers are short and never nest, so the worst case
+//   is the deepest chain under main() plus the largest handler (make stack adds it up from
+//   the avr-gcc call graph).  Estimated by hand: TIMER1_COMPA -> alarm_tick -> alarm_ring ->
+//   buzzer_update -> buzzer_play about 50 bytes, main -> uart_execute -> clock_alarm_set ->
+//   clock_alarm_next or -> countdown_show -> lcd_fb_put_big_bcd -> lcd_cgram_get -> lcd_tx_put
+//   about 70 bytes, so ~120 bytes of the ~1.4 KB the buffers leave on the ATmega328PB.
+#define stack_paint         0xC5
+
+// Wall clock and calendar alarms - time of day and date are packed BCD, like the countdown;
+//   the tick only increments the seconds and compares them with a precomputed cursor, the
+//   date, weekday and the next alarm are worked out by main() once a day or after a change
+#define clock_alarm_count   4                       // calendar alarms
+#define day_Monday          0x01                    // clock_alarm.weekdays bits
+#define day_Tuesday         0x02
+#define day_Wednesday       0x04
+#define day_Thursday        0x08
+#define day_Friday          0x10
+#define day_Saturday        0x20
+#define day_Sunday          0x40
+#define day_Every           0x7F
+#define next_None           0                       // rtc_next_when: no calendar alarm pending
+#define next_Today          1                       //   the cursor is later today
+#define next_Tomorrow       2                       //   the cursor is tomorrow
+
+#ifndef tick_rtc
+#if tick_OCR > 0xFFFF
+#error "tick_OCR does not fit in OCR1A - choose a larger tick_prescaler"
+#endif
+#if tick_error_ppm > tick_max_error_ppm
+#error "countdown tick period is not a whole number of Timer1 clocks - choose another tick_prescaler"
+#endif
+#endif
+
+// Program ID
+uint16_t czas = time_default;                   // alarm time in seconds, packed BCD
+uint16_t drzemka = time_snooze;                 // snooze time in seconds, packed BCD
+uint8_t ekran_gotowy;                           // the first frame has been drawn
+const uint8_t bcd_ascii[16] PROGMEM = "0123456789eeeeee";   // digit -> character, 'e' for a bad digit
+uint8_t lcd_shadow[lcd_Cells];                  // desired display contents, line one then line two
+uint8_t lcd_glass[lcd_Cells];                   // contents last sent to the display RAM
+uint8_t lcd_fb_pos;                             // next cell written by lcd_fb_puts
+uint16_t lcd_bus_writes;                        // instruction and data bytes sent to the LCD
+#ifdef lcd_i2c
+uint8_t lcd_i2c_ctrl;                           // RS and E as they go to the expander
+uint8_t lcd_i2c_last;                           // expander byte last appended, E low
+uint8_t lcd_i2c_buf[5];                         // expander bytes of one instruction or character
+volatile uint8_t lcd_i2c_len;                   // bytes in lcd_i2c_buf
+uint8_t lcd_i2c_pos;                            // next byte TWI0_vect sends
+uint8_t lcd_i2c_errors;                         // bursts dropped on a NACK or bus error
+#endif
+uint8_t lcd_cgram[lcd_cgram_slots];             // glyph_table index held by each CGRAM slot
+uint16_t lcd_cgram_uploads;                     // glyphs sent to CGRAM
+const uint8_t glyph_table[8][8] PROGMEM = {
+    { 0x07, 0x0F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F },    // glyph_LT  left top
+    { 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00 },    // glyph_UB  upper bar
+    { 0x1C, 0x1E, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F },    // glyph_RT  right top
+    { 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x0F, 0x07 },    // glyph_LL  left bottom
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F },    // glyph_LB  lower bar
+    { 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1E, 0x1C },    // glyph_LR  right bottom
+    { 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x1F, 0x1F },    // glyph_UMB upper and middle bars
+    { 0x1F, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F } };  // glyph_LMB middle and lower bars
+const uint8_t big_digit_table[11][6] PROGMEM = {            // top row, then bottom row
+    { glyph_LT,  glyph_UB,  glyph_RT,    glyph_LL,    glyph_LB,    glyph_LR },      // 0
+    { glyph_UB,  glyph_RT,  glyph_Blank, glyph_LB,    glyph_Full,  glyph_LB },      // 1
+    { glyph_UMB, glyph_UMB, glyph_RT,    glyph_LL,    glyph_LB,    glyph_LB },      // 2
+    { glyph_UMB, glyph_UMB, glyph_RT,    glyph_LMB,   glyph_LMB,   glyph_LR },      // 3
+    { glyph_LL,  glyph_LB,  glyph_Full,  glyph_Blank, glyph_Blank, glyph_Full },    // 4
+    { glyph_LL,  glyph_UMB, glyph_UMB,   glyph_LMB,   glyph_LMB,   glyph_LR },      // 5
+    { glyph_LT,  glyph_UMB, glyph_UMB,   glyph_LL,    glyph_LB,    glyph_LR },      // 6
+    { glyph_UB,  glyph_UB,  glyph_RT,    glyph_Blank, glyph_Blank, glyph_Full },    // 7
+    { glyph_LT,  glyph_UMB, glyph_RT,    glyph_LL,    glyph_LB,    glyph_LR },      // 8
+    { glyph_LT,  glyph_UMB, glyph_RT,    glyph_Blank, glyph_Blank, glyph_Full },    // 9
+    { glyph_LT,  glyph_UMB, glyph_UMB,   glyph_LL,    glyph_LB,    glyph_LB } };    // E - bad digit
+volatile uint8_t lcd_tx_byte[lcd_tx_queue_size];    // bytes waiting for TIMER0_COMPA
+volatile uint8_t lcd_tx_flags[lcd_tx_queue_size];   // lcd_tx_RS / lcd_tx_Slow for each byte
+volatile uint8_t lcd_tx_head;                   // written only by main()
+volatile uint8_t lcd_tx_tail;                   // written only by TIMER0_COMPA
+#ifdef lcd_use_busy_flag
+uint8_t lcd_busy_polls;                         // status reads for the byte at the head of the queue
+uint8_t lcd_busy_timeouts;                      // bytes sent without seeing the busy flag clear
+#endif
+volatile uint16_t odliczanie;                   // seconds left in the running countdown, packed BCD
+volatile uint8_t ev_queue[ev_queue_size];       // events from the ISRs, drained by main()
+volatile uint8_t ev_head;                       // written only by the ISRs
+volatile uint8_t ev_tail;                       // written only by main()
+volatile uint8_t ev_dropped;                    // events lost because the queue was full
+volatile uint8_t sched_ready;                   // bit per task that is due to run
+uint8_t sched_delayed;                          // bit per task waiting for its sched_due
+uint32_t sched_due[sched_task_count];           // deadlines in sched_period counts since reset
+volatile uint32_t sched_base;                   // counts at the start of the current second
+uint16_t sched_wakeups;                         // wake-ups in the current second
+uint16_t sched_dispatches;                      // tasks run in the current second
+uint16_t sched_wakeups_last;                    // ... in the last full second
+uint16_t sched_dispatches_last;
+uint32_t sched_overhead;                        // Timer1 counts spent choosing tasks, since command W
+uint16_t sched_overhead_n;                      // dispatches measured in sched_overhead
+#ifdef tick_wdt
+uint32_t wdt_counts = wdt_period_s * wdt_second_counts;  // length of a watchdog period, until calibrated
+int16_t wdt_drift;                              // change of wdt_counts at the last calibration
+uint32_t wdt_phase;                             // Timer1 counts collected toward the next second
+uint16_t wdt_until_cal = 1;                     // watchdog periods to the next calibration
+uint8_t wdt_cal;                                // wdt_cal_Armed, wdt_cal_Timing or 0
+volatile uint8_t wdt_cal_overflows;             // Timer1 overflows in the period being timed
+#endif
+struct alarm
+{
+    uint16_t expiry;                            // alarm_now value at which the alarm fires
+    uint8_t output;                             // PORTE bits pulled low while it rings
+    uint8_t state;                              // alarm_Armed / alarm_Ringing
+    uint8_t heap_pos;                           // its index in alarm_heap while armed
+    uint8_t melody;                             // what the buzzer plays while it rings
+};
+struct alarm alarms[alarm_count];
+uint8_t alarm_heap[alarm_count];                // armed alarms, earliest expiry at [0]
+uint8_t alarm_heap_size;
+uint16_t alarm_now;                             // seconds counted by the tick interrupt
+
+struct clock_alarm
+{
+    uint8_t hour;                               // BCD 0x00 - 0x23
+    uint8_t minute;                             // BCD 0x00 - 0x59
+    uint8_t weekdays;                           // day_ bits, 0 = disabled
+    uint8_t alarm;                              // pool alarm whose Ringing state it uses
+    uint8_t output;                             // PORTE bits pulled low when it fires
+};
+struct clock_alarm clock_alarms[clock_alarm_count];
+volatile uint8_t rtc_hour;                      // time of day, BCD
+volatile uint8_t rtc_minute;
+volatile uint8_t rtc_second;
+uint8_t rtc_year;                               // date, BCD, 2000 - 2099
+uint8_t rtc_month = 0x01;
+uint8_t rtc_day = 0x01;
+uint8_t rtc_weekday = 5;                        // 0 = Monday ... 6 = Sunday (1 Jan 2000 was a Saturday)
+volatile uint8_t rtc_next_hour;                 // cursor: the next calendar alarm to fire
+volatile uint8_t rtc_next_minute;
+volatile uint8_t rtc_next_when;                 // next_None / next_Today / next_Tomorrow
+volatile uint8_t rtc_fired_hour;                // the cursor when ev_ClockAlarm was posted -
+volatile uint8_t rtc_fired_minute;              //   ev_NewDay may move it on before main() fires
+struct note
+{
+    uint16_t step;                              // buzzer_step(frequency), 0 = rest
+    uint8_t length;                             // in 1/32 S, 0 = repeat from the first note
+};
+const struct note melody_beep[] PROGMEM = {
+    { buzzer_step(1000), 8 }, { 0, 8 }, { 0, 0 } };
+const struct note melody_double[] PROGMEM = {
+    { buzzer_step(1500), 3 }, { 0, 2 }, { buzzer_step(1500), 3 }, { 0, 16 }, { 0, 0 } };
+const struct note melody_rise[] PROGMEM = {
+    { buzzer_step(1047), 4 }, { buzzer_step(1175), 4 }, { buzzer_step(1319), 4 },
+    { buzzer_step(1568), 8 }, { 0, 16 }, { 0, 0 } };
+const struct note * const melodies[] PROGMEM = { melody_beep, melody_double, melody_rise };
+const uint8_t buzzer_wave[32] PROGMEM = {       // one period of a sine, 128 +/- 127
+    128, 153, 177, 199, 218, 234, 245, 253, 255, 253, 245, 234, 218, 199, 177, 153,
+    128, 103,  79,  57,  38,  22,  11,   3,   1,   3,  11,  22,  38,  57,  79, 103 };
+uint8_t buzzer_melody = melody_None;            // melody being played
+const struct note *buzzer_note;                 // note being played
+uint16_t buzzer_phase;                          // phase accumulator, top 5 bits index buzzer_wave
+uint16_t buzzer_step_now;                       // step of the current note
+uint8_t buzzer_left;                            // time units left of the current note
+uint8_t buzzer_div;                             // samples left of the current time unit
+struct settings
+{
+    uint16_t sequence;                          // +1 per save, newest wins (serial number arithmetic)
+    uint16_t czas;
+    uint16_t drzemka;
+    uint8_t melody;                             // melody of the front panel alarm
+    uint8_t crc;                                // CRC-8 of the bytes above
+};
+struct settings settings_log[settings_slots] EEMEM;
+struct settings settings_saved;                 // copy of the newest record
+uint8_t settings_slot;                          // where the newest record is
+uint8_t settings_delay;                         // seconds until a pending save, 0 = none
+struct settings settings_tx;                    // record being written by EE_READY
+volatile uint8_t settings_tx_done;              // bytes of settings_tx already written
+volatile uint8_t uart_rx[uart_rx_size];         // bytes waiting for uart_command
+volatile uint8_t uart_rx_head;                  // written only by USART0_RX
+volatile uint8_t uart_rx_tail;                  // written only by main()
+volatile uint8_t uart_rx_dropped;               // bytes lost because uart_rx was full
+volatile uint8_t uart_tx[uart_tx_size];         // bytes waiting for USART0_UDRE
+volatile uint8_t uart_tx_head;                  // written only by main()
+volatile uint8_t uart_tx_tail;                  // written only by USART0_UDRE
+volatile uint8_t uart_awake;                    // seconds the CPU stays in idle for the serial link
+uint8_t uart_line[uart_line_size];              // command being assembled by uart_command
+uint8_t uart_line_len;
+uint8_t uart_period;                            // status every this many seconds, 0 = off
+const uint8_t hex_ascii[16] PROGMEM = "0123456789ABCDEF";
+#ifdef trace_buffer
+struct trace_record
+{
+    uint8_t code;                               // trace_ code
+    uint8_t data;
+    uint16_t time;                              // TCNT1
+};
+struct trace_record trace_log[trace_size];
+uint8_t trace_head;                             // next record to write, the oldest once it has wrapped
+uint8_t trace_on = 1;                           // cleared while the buffer is being dumped
+#endif
+uint8_t buttons_state;                          // debounced levels, 1 = pressed
+uint8_t buttons_ct0;                            // vertical counter, bit 0 of each button's count
+uint8_t buttons_ct1;                            //   and bit 1
+uint8_t buttons_wait;                           // samples until the next repeat or long press
+uint8_t buttons_repeat;                         // current repeat interval in samples
+const uint8_t month_days[12] PROGMEM = { 0x31, 0x28, 0x31, 0x30, 0x31, 0x30, 0x31, 0x31, 0x30, 0x31, 0x30, 0x31 };
+const uint8_t month_weekday[12] PROGMEM = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };   // Sakamoto's offsets
+// Function Prototypes
+void lcd_write_4(uint8_t);
+void lcd_init_4d(void);
+uint8_t lcd_read_4(void);
+uint8_t lcd_read_status_4d(void);
+#ifdef lcd_i2c
+void lcd_i2c_init(void);
+void lcd_i2c_send(void);
+#endif
+void lcd_tx_init(void);
+void lcd_tx_put(uint8_t, uint8_t);
+void lcd_fb_init(void);
+void lcd_fb_clear(void);
+void lcd_fb_goto(uint8_t);
+void lcd_fb_puts(uint8_t *);
+void lcd_fb_puts_P(const char *);
+void lcd_fb_flush(void);
+void lcd_fb_put_bcd(uint16_t);
+uint8_t lcd_cgram_get(uint8_t);
+void lcd_fb_put_big_digit(uint8_t, uint8_t);
+void lcd_fb_put_big_bcd(uint8_t, uint16_t);
+uint16_t bcd_increment(uint16_t);
+uint16_t bcd_decrement(uint16_t);
+void tick_init(void);
+void tick_start(void);
+void tick_sync(void);
+void tick_second(void);
+#ifdef tick_wdt
+void wdt_calibrate(void);
+#endif
+uint8_t sleep_mode_allowed(void);
+uint8_t bcd_byte_increment(uint8_t);
+void rtc_tick(void);
+void rtc_set_time(uint8_t, uint8_t, uint8_t);
+void rtc_set_date(uint8_t, uint8_t, uint8_t, uint8_t);
+void rtc_new_day(void);
+uint8_t rtc_leap_year(uint8_t);
+uint8_t rtc_month_last(uint8_t, uint8_t);
+uint8_t rtc_weekday_of(uint8_t, uint8_t, uint8_t);
+void clock_alarm_set(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t);
+void clock_alarm_next(void);
+void clock_alarm_fire(void);
+void clock_show(void);
+uint16_t bcd_to_seconds(uint16_t);
+uint8_t bcd_valid(uint16_t, uint8_t);
+void alarm_heap_move(uint8_t, uint8_t);
+void alarm_heap_up(uint8_t);
+void alarm_heap_down(uint8_t);
+void alarm_heap_remove(uint8_t);
+void alarm_arm(uint8_t, uint16_t, uint8_t);
+void alarm_cancel(uint8_t);
+void alarm_ring(uint8_t);
+void alarm_silence(uint8_t);
+void alarm_melody(uint8_t, uint8_t);
+void buzzer_init(void);
+void buzzer_play(uint8_t);
+void buzzer_stop(void);
+void buzzer_update(void);
+void alarm_tick(void);
+void countdown(uint16_t);
+void countdown_stop(void);
+void countdown_show(uint16_t);
+void countdown_finish(void);
+uint8_t settings_crc(const struct settings *);
+void settings_load(void);
+void settings_changed(void);
+void settings_second(void);
+void settings_save(void);
+void uart_init(void);
+void uart_putc(uint8_t);
+void uart_puts(uint8_t *);
+void uart_puts_P(const char *);
+void uart_put_hex(uint16_t, uint8_t);
+uint8_t uart_get_hex(uint8_t, uint8_t, uint16_t *);
+void uart_status(void);
+void uart_command(void);
+void uart_execute(void);
+void uart_second(void);
+#ifdef trace_buffer
+void trace_init(void);
+void trace_put(uint8_t, uint8_t);
+void trace_dump(void);
+#endif
+#ifdef __AVR__
+void stack_paint_ram(void) __attribute__((naked, used, section(".init1")));
+#endif
+uint16_t stack_unused(void);
+void buttons_init(void);
+void buttons_pressed(uint8_t);
+void buttons_long(uint8_t);
+void event_put(uint8_t);
+uint8_t event_get(void);
+void sched_init(void);
+void sched_post(uint8_t);
+void sched_after(uint8_t, uint32_t);
+void sched_cancel(uint8_t);
+uint32_t sched_now(void);
+void sched_run(void);
+void task_events(void);
+void task_second(void);
+void task_status(void);
+
+#ifdef tick_rtc
+#define tick_running()      (TIMSK2 & (1<<TOIE2))
+#elif defined(tick_wdt)
+#define tick_running()      (WDTCSR & (1<<WDIE))
+#else
+#define tick_running()      (TCCR1B & tick_clock_mask)
+#endif
+#define countdown_running() (alarms[alarm_ui].state & alarm_Armed)
+#define alarm_ringing(a)    (alarms[a].state & alarm_Ringing)
+
+/*============================== 4-bit LCD Functions ======================*/
+/*
+  Name:     lcd_init_4d
+  Purpose:  initialize the LCD module for a 4-bit data interface
+  Entry:    equates (LCD instructions) set up for the desired operation
+            lcd_tx_init has been called
+  Exit:     no parameters
+  Notes:    the whole sequence, with its power-up and reset delays, is queued for TIMER0_COMPA
+            and the function returns at once; the rest of the system is set up while the LCD
+            waits and anything queued afterwards is sent once the LCD is ready
+            the busy flag cannot be read until the interface is in the 4-bit mode, so the
+            reset sequence always uses time delays
+*/
+void lcd_init_4d(void)
+{
+    bench_main_begin(bench_LcdInit);                // ends at the lcd_tx_InitDone entry
+
+// IMPORTANT - At this point the LCD module is in the 8-bit mode and it is expecting to receive  
+//   8 bits of data, one bit on each of its 8 data lines, each time the 'E' line is pulsed.
+//
+// Since the LCD module is wired for the 4-bit mode, only the upper four data lines are connected to 
+//   the microprocessor and the lower four data lines are typically left open.  Therefore, when 
+//   the 'E' line is pulsed, the LCD controller will read whatever data has been set up on the upper 
+//   four data lines and the lower four data lines will be high (due to internal pull-up circuitry).
+//
+// Fortunately the 'FunctionReset' instruction does not care about what is on the lower four bits so  
+//   this instruction can be sent on just the four available data lines and it will be interpreted 
+//   properly by the LCD controller.  The lcd_tx_Nibble entries send it that way.
+
+// Set up the RS and E lines for the 'lcd_write_4' subroutine.
+    hal_clear_bits(lcd_RS_port, 1<<lcd_RS_bit);     // select the Instruction Register (RS low)
+    hal_clear_bits(lcd_E_port, 1<<lcd_E_bit);       // make sure E is initially low
+#ifdef lcd_use_busy_flag
+    hal_clear_bits(lcd_RW_port, 1<<lcd_RW_bit);     // write mode (RW low)
+#endif
+
+// Power-up delay
+    lcd_tx_put(lcd_power_up_ms, lcd_tx_Pause);      // initial 40 mSec delay
+
+// Reset the LCD controller
+    lcd_tx_put(lcd_FunctionReset, lcd_tx_Nibble);   // first part of reset sequence
+    lcd_tx_put(lcd_reset_ms, lcd_tx_Pause);         // 4.1 mS delay (min)
+
+    lcd_tx_put(lcd_FunctionReset, lcd_tx_Nibble | lcd_tx_Slow); // second part, 100uS delay (min)
+
+    lcd_tx_put(lcd_FunctionReset, lcd_tx_Nibble | lcd_tx_Slow); // third part, delay omitted in the data sheet
+
+// Preliminary Function Set instruction - used only to set the 4-bit mode.
+// The number of lines or the font cannot be set at this time since the controller is still in the
+//  8-bit mode, but the data transfer mode can be changed since this parameter is determined by one 
+//  of the upper four bits of the instruction.
+ 
+    lcd_tx_put(lcd_FunctionSet4bit, lcd_tx_Nibble); // set 4-bit mode, 40uS delay (min)
+
+// Function Set instruction
+    lcd_tx_put(lcd_FunctionSet4bit, 0);             // set mode, lines, and font
+
+// The next three instructions are specified in the data sheet as part of the initialization routine, 
+//  so it is a good idea (but probably not necessary) to do them just as specified and then redo them 
+//  later if the application requires a different configuration.
+
+// Display On/Off Control instruction
+    lcd_tx_put(lcd_DisplayOff, 0);                  // turn display OFF
+
+// Clear Display instruction
+    lcd_tx_put(lcd_Clear, lcd_tx_Slow);             // clear display RAM, 1.64 mS delay (min)
+
+// ; Entry Mode Set instruction
+    lcd_tx_put(lcd_EntryMode, 0);                   // set desired shift characteristics
+
+// This is the end of the LCD controller initialization as specified in the data sheet, but the display
+//  has been left in the OFF condition.  This is a good time to turn the display back ON.
+ 
+// Display On/Off Control instruction
+    lcd_tx_put(lcd_DisplayOn, 0);                   // turn the display ON
+
+// Marks the end of the sequence, after the execution time of Display On, for the benchmarks.
+    lcd_tx_put(0, lcd_tx_Pause | lcd_tx_InitDone);
+}
+
+/*...........................................................................
+  Name:     lcd_write_4
+  Purpose:  send a byte of information to the LCD module
+  Entry:    (theByte) is the information to be sent to the desired LCD register
+            RS is configured for the desired LCD register
+            E is low
+            RW is low
+  Exit:     no parameters
+  Notes:    use either time delays or the busy flag
+            with nibble wiring the other bits of the data port are rewritten with the value
+            just read, so they must not be changed from an interrupt handler meanwhile
+            with lcd_i2c the strobe is only appended to lcd_i2c_buf for lcd_i2c_send; RS
+            and E change in the same expander write, so a new RS goes out first on its own
+*/
+void lcd_write_4(uint8_t theByte)
+{
+#ifdef lcd_i2c
+    uint8_t out = (theByte & 0xF0) | (lcd_i2c_ctrl & lcd_i2c_RS) | lcd_i2c_Light;
+
+    if ((out ^ lcd_i2c_last) & lcd_i2c_RS)
+        lcd_i2c_buf[lcd_i2c_len++] = out;           // RS set up before Enable rises
+    lcd_i2c_buf[lcd_i2c_len++] = out | lcd_i2c_E;   // data set up, Enable high
+    lcd_i2c_buf[lcd_i2c_len++] = out;               // Enable low - the LCD takes the nibble
+    lcd_i2c_last = out;
+#else
+    if (lcd_data_nibble)                                    // D4..D7 = consecutive bits of one port
+    {
+        hal_write(lcd_D4_port, (hal_read(lcd_D4_port) & ~lcd_data_mask) | ((((theByte >> 4) & 0x0F) << lcd_D4_bit) & lcd_data_mask));
+    }
+    else                                                    // arbitrary wiring
+    {
+        hal_clear_bits(lcd_D7_port, 1<<lcd_D7_bit);         // assume that data is '0'
+        if (theByte & 1<<7) hal_set_bits(lcd_D7_port, 1<<lcd_D7_bit); // make data = '1' if necessary
+
+        hal_clear_bits(lcd_D6_port, 1<<lcd_D6_bit);         // repeat for each data bit
+        if (theByte & 1<<6) hal_set_bits(lcd_D6_port, 1<<lcd_D6_bit);
+
+        hal_clear_bits(lcd_D5_port, 1<<lcd_D5_bit);
+        if (theByte & 1<<5) hal_set_bits(lcd_D5_port, 1<<lcd_D5_bit);
+
+        hal_clear_bits(lcd_D4_port, 1<<lcd_D4_bit);
+        if (theByte & 1<<4) hal_set_bits(lcd_D4_port, 1<<lcd_D4_bit);
+    }
+
+// write the data
+                                                    // 'Address set-up time' (40 nS)
+    hal_set_bits(lcd_E_port, 1<<lcd_E_bit);         // Enable pin high
+    hal_delay_us(1);                                // implement 'Data set-up time' (80 nS) and 'Enable pulse width' (230 nS)
+    hal_clear_bits(lcd_E_port, 1<<lcd_E_bit);       // Enable pin low
+    hal_delay_us(1);                                // implement 'Data hold time' (10 nS) and 'Enable cycle time' (500 nS)
+#endif
+}
+
+/*...........................................................................
+  Name:     lcd_read_4
+  Purpose:  read four bits of information from the LCD module
+  Entry:    RS is configured for the desired LCD register
+            RW is high, E is low
+            the data lines are inputs
+  Exit:     the four bits are returned in the upper half of the byte
+  Notes:    used only with lcd_use_busy_flag
+*/
+uint8_t lcd_read_4(void)
+{
+    uint8_t theNibble = 0;
+
+    hal_set_bits(lcd_E_port, 1<<lcd_E_bit);         // Enable pin high
+    hal_delay_us(1);                                // implement 'Data delay time' (160 nS) and 'Enable pulse width' (230 nS)
+    if (lcd_data_nibble)
+    {
+        theNibble = ((hal_read(lcd_D4_pin) & lcd_data_mask) >> lcd_D4_bit) << 4;
+    }
+    else
+    {
+        if (hal_read(lcd_D7_pin) & (1<<lcd_D7_bit)) theNibble |= 1<<7;
+        if (hal_read(lcd_D6_pin) & (1<<lcd_D6_bit)) theNibble |= 1<<6;
+        if (hal_read(lcd_D5_pin) & (1<<lcd_D5_bit)) theNibble |= 1<<5;
+        if (hal_read(lcd_D4_pin) & (1<<lcd_D4_bit)) theNibble |= 1<<4;
+    }
+    hal_clear_bits(lcd_E_port, 1<<lcd_E_bit);       // Enable pin low
+    hal_delay_us(1);                                // implement 'Enable cycle time' (500 nS)
+    return theNibble;
+}
+
+/*...........................................................................
+  Name:     lcd_read_status_4d
+  Purpose:  read the busy flag and the address counter
+  Entry:    no parameters
+  Exit:     bit 7 is the busy flag, bits 6..0 are the address counter
+  Notes:    leaves the data lines as outputs and RW low, ready for the next write
+*/
+uint8_t lcd_read_status_4d(void)
+{
+    uint8_t theStatus;
+
+    hal_clear_bits(lcd_D7_ddr, 1<<lcd_D7_bit);      // 4 data lines - input
+    hal_clear_bits(lcd_D6_ddr, 1<<lcd_D6_bit);
+    hal_clear_bits(lcd_D5_ddr, 1<<lcd_D5_bit);
+    hal_clear_bits(lcd_D4_ddr, 1<<lcd_D4_bit);
+    hal_clear_bits(lcd_D7_port, 1<<lcd_D7_bit);     // no pull-ups
+    hal_clear_bits(lcd_D6_port, 1<<lcd_D6_bit);
+    hal_clear_bits(lcd_D5_port, 1<<lcd_D5_bit);
+    hal_clear_bits(lcd_D4_port, 1<<lcd_D4_bit);
+
+    hal_clear_bits(lcd_RS_port, 1<<lcd_RS_bit);     // select the Instruction Register (RS low)
+    hal_clear_bits(lcd_E_port, 1<<lcd_E_bit);       // make sure E is initially low
+    hal_set_bits(lcd_RW_port, 1<<lcd_RW_bit);       // read mode (RW high)
+                                                    // 'Address set-up time' (40 nS)
+    theStatus = lcd_read_4();                       // busy flag and upper 3 bits of the address
+    theStatus |= lcd_read_4() >> 4;                 // lower 4 bits of the address
+
+    hal_clear_bits(lcd_RW_port, 1<<lcd_RW_bit);     // back to write mode (RW low)
+    hal_set_bits(lcd_D7_ddr, 1<<lcd_D7_bit);        // 4 data lines - output
+    hal_set_bits(lcd_D6_ddr, 1<<lcd_D6_bit);
+    hal_set_bits(lcd_D5_ddr, 1<<lcd_D5_bit);
+    hal_set_bits(lcd_D4_ddr, 1<<lcd_D4_bit);
+    return theStatus;
+}
+
+/*============================== LCD Transmit Queue =======================*/
+/*
+  Name:     lcd_tx_init
+  Purpose:  set up Timer0 to pace the LCD transmit queue
+  Entry:    the LCD pins are outputs; called first, before lcd_init_4d or anything else
+            is queued
+  Exit:     no parameters
+  Notes:    the timer runs only while there is something to send
+*/
+void lcd_tx_init(void)
+{
+    TCCR0A = (1<<WGM01);                            // CTC, TOP = OCR0A
+    TCCR0B = 0;                                     // clock stopped
+    TIMSK0 |= (1<<OCIE0A);
+    lcd_tx_head = lcd_tx_tail = 0;
+}
+
+/*...........................................................................
+  Name:     lcd_tx_put
+  Purpose:  queue one byte for the LCD and return without waiting for it
+  Entry:    (theByte) is an instruction or a character
+            (theFlags) is lcd_tx_RS for a character, lcd_tx_Slow for Clear or Home,
+            lcd_tx_Nibble for the reset sequence, or lcd_tx_Pause with (theByte) milliseconds
+  Exit:     no parameters
+  Notes:    call only from main(); sleeps while the queue is full
+*/
+void lcd_tx_put(uint8_t theByte, uint8_t theFlags)
+{
+    uint8_t head = lcd_tx_head;
+    uint8_t next = (head + 1) & (lcd_tx_queue_size - 1);
+
+    while (next == lcd_tx_tail)                     // full - TIMER0_COMPA will make room
+    {
+        cli();
+        if (next == lcd_tx_tail)
+        {
+            set_sleep_mode(SLEEP_MODE_IDLE);        // Timer0 needs the I/O clock
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+    }
+    lcd_tx_byte[head] = theByte;
+    lcd_tx_flags[head] = theFlags;
+    lcd_tx_head = next;                             // publish only after the slot is written
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (!lcd_tx_busy())                         // idle - send the byte on the next count
+        {
+            TCNT0 = 0;
+            OCR0A = 0;
+            TIFR0 = (1<<OCF0A);
+            TCCR0B = lcd_tx_clock_select;
+        }
+    }
+}
+
+/*...........................................................................
+  Name:     TIMER0_COMPA interrupt
+  Purpose:  send the next queued byte once the previous one has been executed
+  Notes:    both nibbles go out in one call (a few uS); the compare value is then set to the
+            execution time of that byte - or one count if the busy flag is polled instead;
+            after lcd_busy_timeout reads that all saw it set, the byte goes out after the
+            lcd_tx_Slow delay, so a display that never clears it cannot stall the queue
+            a pause stays at the head of the queue, counting its milliseconds down one
+            compare match at a time; reset nibbles are always timed
+*/
+ISR  (TIMER0_COMPA_vect)
+{
+    uint8_t tail = lcd_tx_tail;
+    uint8_t theByte;
+    uint8_t theFlags;
+
+    probe_on();
+    if (lcd_i2c_busy())                             // the previous burst is still on the bus
+    {
+        OCR0A = 0;
+        probe_off();
+        return;
+    }
+    if (tail == lcd_tx_head)                        // the last byte has been executed
+    {
+        TCCR0B &= ~lcd_tx_clock_mask;
+        event_put(ev_LcdIdle);
+        bench_main_end(bench_Redraw);               // the frame is on the display
+        probe_off();
+        return;
+    }
+    theByte = lcd_tx_byte[tail];
+    theFlags = lcd_tx_flags[tail];
+    if (theFlags & lcd_tx_Pause)
+    {
+        if (theByte)                                // another millisecond
+        {
+            lcd_tx_byte[tail] = theByte - 1;
+            OCR0A = lcd_tx_ms_counts - 1;
+        }
+        else                                        // done - the next entry on the next count
+        {
+            if (theFlags & lcd_tx_InitDone)
+                bench_main_end(bench_LcdInit);
+            lcd_tx_tail = (tail + 1) & (lcd_tx_queue_size - 1);
+            OCR0A = 0;
+        }
+        probe_off();
+        return;
+    }
+#ifdef lcd_use_busy_flag
+    if (!(theFlags & lcd_tx_Nibble) && lcd_busy_polls <= lcd_busy_timeout && (lcd_read_status_4d() & 0x80))
+    {
+        if (++lcd_busy_polls < lcd_busy_timeout)
+            OCR0A = 0;                              // still busy - look again on the next count
+        else                                        // stuck or missing - wait as without RW, then send
+        {
+            lcd_busy_polls = lcd_busy_timeout + 1;
+            lcd_busy_timeouts++;
+            OCR0A = lcd_tx_slow_counts - 1;
+        }
+        probe_off();
+        return;
+    }
+    lcd_busy_polls = 0;
+#endif
+    bench_isr(bench_LcdByte);
+    if (theFlags & lcd_tx_RS)
+        hal_set_bits(lcd_RS_port, 1<<lcd_RS_bit);   // select the Data Register (RS high)
+    else
+        hal_clear_bits(lcd_RS_port, 1<<lcd_RS_bit); // select the Instruction Register (RS low)
+    hal_clear_bits(lcd_E_port, 1<<lcd_E_bit);       // make sure E is initially low
+    if (!(theFlags & lcd_tx_RS))
+        trace(trace_LcdInstr, theByte);
+    lcd_write_4(theByte);                           // write the upper 4-bits of the data
+    if (!(theFlags & lcd_tx_Nibble))
+        lcd_write_4(theByte << 4);                  // write the lower 4-bits of the data
+    lcd_bus_writes++;
+#ifdef lcd_i2c
+    lcd_i2c_send();
+#endif
+    lcd_tx_tail = (tail + 1) & (lcd_tx_queue_size - 1);
+
+#ifdef lcd_use_busy_flag
+    if (!(theFlags & lcd_tx_Nibble))
+        OCR0A = 0;
+    else
+#endif
+    OCR0A = ((theFlags & lcd_tx_Slow) ? lcd_tx_slow_counts : lcd_tx_fast_counts) - 1;
+    bench_isr(bench_None);
+    probe_off();
+}
+
+#ifdef lcd_i2c
+/*============================== I2C Backpack =============================*/
+/*
+  Name:     lcd_i2c_init
+  Purpose:  set up TWI0 for the PCF8574
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    the expander powers up with all its pins high, E included; one byte with
+            everything low is queued at once and goes out as soon as sei() lets TWI0_vect
+            run, long before the LCD power-on wait ends
+*/
+void lcd_i2c_init(void)
+{
+    TWSR0 = 0;                                      // prescaler 1
+    TWBR0 = (F_CPU / lcd_i2c_Hz - 16) / 2;
+    TWCR0 = (1<<TWEN);
+    lcd_i2c_ctrl = 0;
+    lcd_i2c_last = lcd_i2c_Light;
+    lcd_i2c_buf[0] = lcd_i2c_Light;                 // E and RS low
+    lcd_i2c_len = 1;
+    lcd_i2c_send();
+}
+
+/*...........................................................................
+  Name:     lcd_i2c_send
+  Purpose:  start sending lcd_i2c_buf as one burst
+  Entry:    lcd_i2c_buf holds lcd_i2c_len bytes, the bus is idle
+  Exit:     no parameters
+  Notes:    returns at once; lcd_i2c_busy() stays true until the stop condition
+*/
+void lcd_i2c_send(void)
+{
+    lcd_i2c_pos = 0;
+    TWCR0 = (1<<TWINT)|(1<<TWSTA)|(1<<TWEN)|(1<<TWIE);
+}
+
+/*...........................................................................
+  Name:     TWI0_vect
+  Purpose:  step a burst along - address, the bytes of lcd_i2c_buf, stop
+  Entry:    TWSR0 holds the status of the last bus action
+  Exit:     no parameters
+  Notes:    a burst that is not acknowledged is dropped and counted; the LCD then misses
+            one byte, which the next full redraw repairs
+*/
+ISR(TWI0_vect)
+{
+    switch (TWSR0 & 0xF8)
+    {
+        case 0x08:                                  // start sent
+        case 0x10:                                  // repeated start sent
+        TWDR0 = lcd_i2c_address << 1;               // SLA+W
+        TWCR0 = (1<<TWINT)|(1<<TWEN)|(1<<TWIE);
+        return;
+        case 0x18:                                  // SLA+W acknowledged
+        case 0x28:                                  // data acknowledged
+        if (lcd_i2c_pos < lcd_i2c_len)
+        {
+            TWDR0 = lcd_i2c_buf[lcd_i2c_pos++];
+            TWCR0 = (1<<TWINT)|(1<<TWEN)|(1<<TWIE);
+            return;
+        }
+        break;
+        default:                                    // NACK, lost arbitration or bus error
+        lcd_i2c_errors++;
+    }
+    TWCR0 = (1<<TWINT)|(1<<TWSTO)|(1<<TWEN);        // stop, interrupt off - the bus is free
+    lcd_i2c_len = 0;
+}
+
+#endif
+/*============================== LCD Frame Buffer =========================*/
+/*
+  Name:     lcd_fb_init
+  Purpose:  start the frame buffer from a blank display
+  Entry:    the display has just been cleared (lcd_init_4d or lcd_Clear)
+  Exit:     no parameters
+*/
+void lcd_fb_init(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < lcd_Cells; i++)
+        lcd_glass[i] = ' ';
+    for (i = 0; i < lcd_cgram_slots; i++)
+        lcd_cgram[i] = lcd_cgram_empty;             // CGRAM holds garbage after power-up
+    lcd_fb_clear();
+}
+
+/*...........................................................................
+  Name:     lcd_fb_clear
+  Purpose:  blank the frame buffer and move its cursor to the start of line one
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    nothing is sent to the display until lcd_fb_flush
+*/
+void lcd_fb_clear(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < lcd_Cells; i++)
+        lcd_shadow[i] = ' ';
+    lcd_fb_pos = 0;
+}
+
+/*...........................................................................
+  Name:     lcd_fb_goto
+  Purpose:  move the frame buffer cursor
+  Entry:    (theCell) is 0..15 for line one, 16..31 for line two
+  Exit:     no parameters
+*/
+void lcd_fb_goto(uint8_t theCell)
+{
+    lcd_fb_pos = theCell;
+}
+
+/*...........................................................................
+  Name:     lcd_fb_puts
+  Purpose:  place a string in the frame buffer at its cursor
+  Entry:    (theString) is the string to be displayed
+  Exit:     no parameters
+  Notes:    text running past the end of line two is dropped
+*/
+void lcd_fb_puts(uint8_t theString[])
+{
+    uint8_t i = 0;
+
+    while (theString[i] != 0 && lcd_fb_pos < lcd_Cells)
+        lcd_shadow[lcd_fb_pos++] = theString[i++];
+}
+
+/*...........................................................................
+  Name:     lcd_fb_puts_P
+  Purpose:  place a string kept in flash in the frame buffer at its cursor
+  Entry:    (theString) is the string, declared PROGMEM or made with PSTR()
+  Exit:     no parameters
+  Notes:    text running past the end of line two is dropped; like lcd_fb_puts, the
+            text reaches the display through the queue at the next lcd_fb_flush
+*/
+void lcd_fb_puts_P(const char *theString)
+{
+    uint8_t c;
+
+    while ((c = pgm_read_byte(theString++)) != 0 && lcd_fb_pos < lcd_Cells)
+        lcd_shadow[lcd_fb_pos++] = c;
+}
+
+/*...........................................................................
+  Name:     lcd_fb_flush
+  Purpose:  bring the display up to date with the frame buffer
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    only cells that differ from the display are sent; a Set Cursor instruction is
+            issued only when the next changed cell does not follow the previous one, so a
+            countdown tick normally costs two bus writes instead of a 4 mS clear and a redraw;
+            the bytes are queued and the frame is on the display once lcd_tx_busy() is false
+            (ev_LcdIdle)
+*/
+void lcd_fb_flush(void)
+{
+    uint8_t i;
+    uint8_t cursor = 0xFF;                          // cell the DDRAM address counter points at
+
+    for (i = 0; i < lcd_Cells; i++)
+    {
+        if (lcd_shadow[i] == lcd_glass[i])
+            continue;
+        if (cursor != i)
+            lcd_tx_put(lcd_SetCursor | lcd_cell_address(i), 0);
+        lcd_tx_put(lcd_shadow[i], lcd_tx_RS);
+        lcd_glass[i] = lcd_shadow[i];
+        cursor = (i == lcd_Columns - 1) ? 0xFF : i + 1;   // line one does not run into line two
+    }
+}
+
+/*...........................................................................
+  Name:     lcd_fb_put_bcd
+  Purpose:  place a packed BCD time in the frame buffer at its cursor
+  Entry:    (theTime) is three packed BCD digits
+  Exit:     no parameters
+  Notes:    one table lookup per digit, no division
+*/
+void lcd_fb_put_bcd(uint16_t theTime)
+{
+    uint8_t digits[4];
+
+    digits[0] = bcd_char(theTime >> 8);
+    digits[1] = bcd_char(theTime >> 4);
+    digits[2] = bcd_char(theTime);
+    digits[3] = 0;
+    lcd_fb_puts(digits);
+}
+
+/*...........................................................................
+  Name:     lcd_cgram_get
+  Purpose:  make sure a glyph is in CGRAM
+  Entry:    (theGlyph) is a glyph_table index
+  Exit:     the character code that shows it, or a space if no slot can be freed
+  Notes:    a missing glyph goes into a slot that no cell of the display or of the frame
+            buffer uses, so nothing on the glass changes shape; the upload is queued ahead of
+            the frame, and lcd_fb_flush always starts with a Set Cursor, which moves the
+            address counter back to the display RAM
+*/
+uint8_t lcd_cgram_get(uint8_t theGlyph)
+{
+    uint8_t slot;
+    uint8_t i;
+    uint8_t used = 0;
+
+    for (slot = 0; slot < lcd_cgram_slots; slot++)
+        if (lcd_cgram[slot] == theGlyph)
+            return lcd_cgram_char(slot);
+    for (i = 0; i < lcd_Cells; i++)                 // slots on show now or in the next frame
+    {
+        if ((lcd_glass[i] & 0xF8) == lcd_cgram_char(0))
+            used |= 1 << (lcd_glass[i] & 0x07);
+        if ((lcd_shadow[i] & 0xF8) == lcd_cgram_char(0))
+            used |= 1 << (lcd_shadow[i] & 0x07);
+    }
+    for (slot = 0; slot < lcd_cgram_slots; slot++)
+        if (lcd_cgram[slot] == lcd_cgram_empty)     // an empty slot first
+            break;
+    if (slot == lcd_cgram_slots)
+        for (slot = 0; slot < lcd_cgram_slots && (used & (1 << slot)); slot++)
+            ;
+    if (slot == lcd_cgram_slots)
+        return ' ';
+    lcd_tx_put(lcd_SetCGRAM | (slot << 3), 0);
+    for (i = 0; i < 8; i++)
+        lcd_tx_put(pgm_read_byte(&glyph_table[theGlyph][i]), lcd_tx_RS);
+    lcd_cgram[slot] = theGlyph;
+    lcd_cgram_uploads++;
+    return lcd_cgram_char(slot);
+}
+
+/*...........................................................................
+  Name:     lcd_fb_put_big_digit
+  Purpose:  place a large digit in the frame buffer
+  Entry:    (theCell) is its top left cell on line one, (theDigit) is 0 - 9, anything else
+            shows E
+  Exit:     no parameters
+*/
+void lcd_fb_put_big_digit(uint8_t theCell, uint8_t theDigit)
+{
+    uint8_t i;
+    uint8_t piece;
+
+    if (theDigit > 9)
+        theDigit = 10;
+    for (i = 0; i < 6; i++)
+    {
+        piece = pgm_read_byte(&big_digit_table[theDigit][i]);
+        if (piece < lcd_cgram_slots)
+            piece = lcd_cgram_get(piece);
+        lcd_shadow[theCell + ((i < 3) ? i : lcd_Columns + i - 3)] = piece;
+    }
+}
+
+/*...........................................................................
+  Name:     lcd_fb_put_big_bcd
+  Purpose:  place a packed BCD time in the frame buffer as three large digits
+  Entry:    (theCell) is the top left cell on line one, (theTime) is three packed BCD digits
+  Exit:     no parameters
+  Notes:    takes big_Width * 3 - 1 columns of both lines
+*/
+void lcd_fb_put_big_bcd(uint8_t theCell, uint16_t theTime)
+{
+    lcd_fb_put_big_digit(theCell, (theTime >> 8) & 0x0F);
+    lcd_fb_put_big_digit(theCell + big_Width, (theTime >> 4) & 0x0F);
+    lcd_fb_put_big_digit(theCell + 2 * big_Width, theTime & 0x0F);
+}
+
+/*============================== BCD Time =================================*/
+/*
+  Name:     bcd_increment
+  Purpose:  add one second to a packed BCD time
+  Entry:    (theTime) is three packed BCD digits
+  Exit:     the new time; 999 wraps around to 000
+*/
+uint16_t bcd_increment(uint16_t theTime)
+{
+    if ((theTime & 0x00F) != 0x009)
+        return theTime + 0x001;
+    if ((theTime & 0x0F0) != 0x090)
+        return (theTime & 0xFF0) + 0x010;           // x y 9 -> x y+1 0
+    if ((theTime & 0xF00) != 0x900)
+        return (theTime & 0xF00) + 0x100;           // x 9 9 -> x+1 0 0
+    return 0x000;
+}
+
+/*...........................................................................
+  Name:     bcd_decrement
+  Purpose:  subtract one second from a packed BCD time
+  Entry:    (theTime) is three packed BCD digits
+  Exit:     the new time; 000 wraps around to 999
+*/
+uint16_t bcd_decrement(uint16_t theTime)
+{
+    if (theTime & 0x00F)
+        return theTime - 0x001;
+    if (theTime & 0x0F0)
+        return theTime - 0x010 + 0x009;             // x y 0 -> x y-1 9
+    if (theTime & 0xF00)
+        return theTime - 0x100 + 0x099;             // x 0 0 -> x-1 9 9
+    return 0x999;
+}
+
+/*...........................................................................
+  Name:     bcd_to_seconds
+  Purpose:  convert a packed BCD time to binary
+  Entry:    (theTime) is three packed BCD digits
+  Exit:     the number of seconds
+  Notes:    multiplies by ten with shifts - used only when an alarm is armed
+*/
+uint16_t bcd_to_seconds(uint16_t theTime)
+{
+    uint16_t seconds = (theTime >> 8) & 0x0F;
+
+    seconds = (seconds << 3) + (seconds << 1) + ((theTime >> 4) & 0x0F);
+    seconds = (seconds << 3) + (seconds << 1) + (theTime & 0x0F);
+    return seconds;
+}
+
+/*...........................................................................
+  Name:     bcd_valid
+  Purpose:  check that a number read from outside is packed BCD
+  Entry:    (theValue) is the number, (theDigits) how many BCD digits it may have, 1 - 4
+  Exit:     non-zero when every digit is 0 - 9 and no bit is set above the last digit
+*/
+uint8_t bcd_valid(uint16_t theValue, uint8_t theDigits)
+{
+    if (theDigits < 4 && (theValue >> (theDigits * 4)))
+        return 0;
+    for (; theValue; theValue >>= 4)
+        if ((theValue & 0x0F) > 9)
+            return 0;
+    return 1;
+}
+
+/*============================== Alarm Scheduler ==========================*/
+/*
+  Name:     alarm_heap_move
+  Purpose:  place an alarm at a position in the heap
+  Entry:    (theAlarm) is the alarm, (thePos) the heap index
+  Exit:     no parameters
+*/
+void alarm_heap_move(uint8_t theAlarm, uint8_t thePos)
+{
+    alarm_heap[thePos] = theAlarm;
+    alarms[theAlarm].heap_pos = thePos;
+}
+
+/*...........................................................................
+  Name:     alarm_heap_up
+  Purpose:  move the alarm at (thePos) towards the top until its parent expires earlier
+  Entry:    (thePos) is a heap index
+  Exit:     no parameters
+*/
+void alarm_heap_up(uint8_t thePos)
+{
+    uint8_t theAlarm = alarm_heap[thePos];
+    uint8_t parent;
+
+    while (thePos > 0)
+    {
+        parent = (thePos - 1) >> 1;
+        if (!alarm_before(theAlarm, alarm_heap[parent]))
+            break;
+        alarm_heap_move(alarm_heap[parent], thePos);
+        thePos = parent;
+    }
+    alarm_heap_move(theAlarm, thePos);
+}
+
+/*...........................................................................
+  Name:     alarm_heap_down
+  Purpose:  move the alarm at (thePos) away from the top until its children expire later
+  Entry:    (thePos) is a heap index
+  Exit:     no parameters
+*/
+void alarm_heap_down(uint8_t thePos)
+{
+    uint8_t theAlarm = alarm_heap[thePos];
+    uint8_t child;
+
+    while ((child = (thePos << 1) + 1) < alarm_heap_size)
+    {
+        if (child + 1 < alarm_heap_size && alarm_before(alarm_heap[child + 1], alarm_heap[child]))
+            child++;                                // the earlier of the two children
+        if (!alarm_before(alarm_heap[child], theAlarm))
+            break;
+        alarm_heap_move(alarm_heap[child], thePos);
+        thePos = child;
+    }
+    alarm_heap_move(theAlarm, thePos);
+}
+
+/*...........................................................................
+  Name:     alarm_heap_remove
+  Purpose:  take the alarm at (thePos) out of the heap
+  Entry:    (thePos) is a heap index
+  Exit:     no parameters
+  Notes:    O(log n); the last alarm fills the hole and is moved up or down
+*/
+void alarm_heap_remove(uint8_t thePos)
+{
+    uint8_t last = alarm_heap[--alarm_heap_size];
+
+    if (thePos == alarm_heap_size)
+        return;
+    alarm_heap_move(last, thePos);
+    alarm_heap_up(thePos);
+    alarm_heap_down(alarms[last].heap_pos);
+}
+
+/*...........................................................................
+  Name:     alarm_arm
+  Purpose:  (re)start an alarm
+  Entry:    (theAlarm) is the alarm, 0 .. alarm_count-1
+            (theSeconds) is the delay, 1 .. 32767
+            (theOutput) are the PORTE bits to pull low when it fires
+  Exit:     no parameters
+  Notes:    call from main(); the tick runs continuously for the wall clock, so the first
+            second of a new alarm may be short - alarms fire on the clock's second boundary
+*/
+void alarm_arm(uint8_t theAlarm, uint16_t theSeconds, uint8_t theOutput)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (alarms[theAlarm].state & alarm_Armed)
+            alarm_heap_remove(alarms[theAlarm].heap_pos);
+        alarms[theAlarm].expiry = alarm_now + theSeconds;
+        alarms[theAlarm].output = theOutput;
+        alarms[theAlarm].state |= alarm_Armed;
+        alarm_heap_move(theAlarm, alarm_heap_size++);
+        alarm_heap_up(alarm_heap_size - 1);
+    }
+}
+
+/*...........................................................................
+  Name:     alarm_cancel
+  Purpose:  stop an alarm without firing it
+  Entry:    (theAlarm) is the alarm
+  Exit:     no parameters
+  Notes:    call from main()
+*/
+void alarm_cancel(uint8_t theAlarm)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (alarms[theAlarm].state & alarm_Armed)
+        {
+            alarm_heap_remove(alarms[theAlarm].heap_pos);
+            alarms[theAlarm].state &= ~alarm_Armed;
+        }
+    }
+}
+
+/*...........................................................................
+  Name:     alarm_ring
+  Purpose:  fire an alarm - pull its output bits low
+  Entry:    (theAlarm) is the alarm
+  Exit:     no parameters
+  Notes:    called from the tick interrupt, or from main() with interrupts disabled; an armed
+            alarm is taken out of the heap first, so a calendar alarm may share a pool alarm
+            that is counting down - the countdown then ends as if it had expired
+*/
+void alarm_ring(uint8_t theAlarm)
+{
+    if (alarms[theAlarm].state & alarm_Armed)
+    {
+        alarm_heap_remove(alarms[theAlarm].heap_pos);
+        if (theAlarm == alarm_ui)
+            event_put(ev_Done);
+    }
+    alarms[theAlarm].state = alarm_Ringing;
+    hal_clear_bits(PORTE, alarms[theAlarm].output);
+    buzzer_update();
+}
+
+/*...........................................................................
+  Name:     alarm_silence
+  Purpose:  stop a ringing alarm - release its output bits
+  Entry:    (theAlarm) is the alarm
+  Exit:     no parameters
+*/
+void alarm_silence(uint8_t theAlarm)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (alarms[theAlarm].state & alarm_Ringing)
+        {
+            alarms[theAlarm].state &= ~alarm_Ringing;
+            hal_set_bits(PORTE, alarms[theAlarm].output);
+            buzzer_update();
+        }
+    }
+}
+
+/*...........................................................................
+  Name:     alarm_melody
+  Purpose:  choose what the buzzer plays while an alarm rings
+  Entry:    (theAlarm) is the alarm, (theMelody) is a melody_ index
+  Exit:     no parameters
+  Notes:    takes effect the next time the alarm starts ringing
+*/
+void alarm_melody(uint8_t theAlarm, uint8_t theMelody)
+{
+    alarms[theAlarm].melody = theMelody;
+}
+
+/*...........................................................................
+  Name:     alarm_tick
+  Purpose:  advance the alarm clock by one second and fire the alarms that are due
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called from the tick interrupt; without an expiry the work is one increment and
+            one compare however many alarms are armed, each alarm that fires costs an
+            O(log n) heap removal
+*/
+void alarm_tick(void)
+{
+    alarm_now++;
+    if (countdown_running())                        // the front panel shows this one
+        odliczanie = bcd_decrement(odliczanie);
+    while (alarm_heap_size && (int16_t)(alarms[alarm_heap[0]].expiry - alarm_now) <= 0)
+        alarm_ring(alarm_heap[0]);
+}
+
+/*============================== Buzzer ===================================*/
+/*
+  Name:     buzzer_init
+  Purpose:  set up Timer4 and the buzzer pin
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    the timer is left stopped until buzzer_play()
+*/
+void buzzer_init(void)
+{
+    hal_set_bits(buzzer_ddr, 1<<buzzer_bit);
+    TCCR4A = (1<<WGM40);                            // fast PWM 8-bit, OC4B disconnected
+    TCCR4B = (1<<WGM42);                            // clock stopped
+    OCR4B = 128;
+    TIMSK4 |= (1<<TOIE4);
+}
+
+/*...........................................................................
+  Name:     buzzer_play
+  Purpose:  start a melody from its first note
+  Entry:    (theMelody) is a melody_ index
+  Exit:     no parameters
+  Notes:    call with interrupts disabled
+*/
+void buzzer_play(uint8_t theMelody)
+{
+    buzzer_melody = theMelody;
+    buzzer_note = pgm_read_ptr(&melodies[theMelody]);
+    buzzer_step_now = pgm_read_word(&buzzer_note->step);
+    buzzer_left = pgm_read_byte(&buzzer_note->length);
+    buzzer_div = buzzer_seq_div;
+    buzzer_phase = 0;
+    if (!buzzer_playing())
+    {
+        TCNT4 = 0;
+        TCCR4A |= (1<<COM4B1);                      // OC4B non-inverting
+        TCCR4B |= buzzer_clock_select;
+    }
+}
+
+/*...........................................................................
+  Name:     buzzer_stop
+  Purpose:  silence the buzzer and stop Timer4
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    call with interrupts disabled; the pin is left low so the piezo carries no DC
+*/
+void buzzer_stop(void)
+{
+    TCCR4B &= ~buzzer_clock_mask;
+    TCCR4A &= ~(1<<COM4B1);                         // hand the pin back to PORTD
+    hal_clear_bits(buzzer_port, 1<<buzzer_bit);
+    buzzer_melody = melody_None;
+}
+
+/*...........................................................................
+  Name:     buzzer_update
+  Purpose:  play the melody of the lowest-numbered ringing alarm, or nothing
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called by alarm_ring and alarm_silence with interrupts disabled; a melody that
+            is already playing is not restarted
+*/
+void buzzer_update(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < alarm_count; i++)
+    {
+        if (alarms[i].state & alarm_Ringing)
+        {
+            if (alarms[i].melody != buzzer_melody)
+                buzzer_play(alarms[i].melody);
+            return;
+        }
+    }
+    if (buzzer_melody != melody_None)
+        buzzer_stop();
+}
+
+/*...........................................................................
+  Name:     TIMER4_OVF_vect
+  Purpose:  output the next buzzer sample and step the melody
+  Entry:    once per PWM period, buzzer_sample_Hz
+  Exit:     no parameters
+  Notes:    one add, one flash table read and a counter decrement - about 50 clock cycles of
+            every 2048, i.e. ~2.5 % of the CPU while an alarm rings (the same share at 8 MHz,
+            where the sample rate halves); the next note is fetched 32 times a second at most
+*/
+ISR(TIMER4_OVF_vect)
+{
+    bench_isr(bench_BuzzerIsr);
+    buzzer_phase += buzzer_step_now;
+    OCR4B = pgm_read_byte(&buzzer_wave[buzzer_phase >> 11]);
+    if (--buzzer_div == 0)
+    {
+        buzzer_div = buzzer_seq_div;
+        if (--buzzer_left == 0)
+        {
+            buzzer_note++;
+            buzzer_left = pgm_read_byte(&buzzer_note->length);
+            if (buzzer_left == 0)                   // end of the melody - play it again
+            {
+                buzzer_note = pgm_read_ptr(&melodies[buzzer_melody]);
+                buzzer_left = pgm_read_byte(&buzzer_note->length);
+            }
+            buzzer_step_now = pgm_read_word(&buzzer_note->step);
+        }
+    }
+    bench_isr(bench_None);
+}
+
+/*============================== Settings Store ===========================*/
+/*
+  Name:     settings_crc
+  Purpose:  compute the CRC of a settings record
+  Entry:    (theRecord) points at the record
+  Exit:     CRC-8 (CCITT) of every byte before the crc field
+  Notes:    seeded with 0xFF - from 0 a record of all zeros would carry a valid CRC of 0
+*/
+uint8_t settings_crc(const struct settings *theRecord)
+{
+    const uint8_t *p = (const uint8_t *)theRecord;
+    uint8_t crc = 0xFF;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(struct settings) - 1; i++)
+        crc = _crc8_ccitt_update(crc, p[i]);
+    return crc;
+}
+
+/*...........................................................................
+  Name:     settings_load
+  Purpose:  restore the settings from the newest valid record
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    one pass over the log; a record is newer when its sequence number is ahead in
+            16-bit serial arithmetic, which holds because the log is much shorter than 32768
+            records; a record counts only if its CRC matches and its times are three BCD
+            digits, the snooze time not zero, and its melody exists; with no valid record
+            the defaults stay and the log starts at slot 0
+*/
+void settings_load(void)
+{
+    struct settings theRecord;
+    uint8_t found = 0;
+    uint8_t i;
+
+    settings_slot = settings_slots - 1;
+    settings_saved.sequence = 0;
+    for (i = 0; i < settings_slots; i++)
+    {
+        eeprom_read_block(&theRecord, &settings_log[i], sizeof(struct settings));
+        if (theRecord.sequence == settings_seq_erased || theRecord.crc != settings_crc(&theRecord))
+            continue;
+        if (!bcd_valid(theRecord.czas, 3) || !bcd_valid(theRecord.drzemka, 3) || !theRecord.drzemka
+            || theRecord.melody >= sizeof(melodies) / sizeof(melodies[0]))
+            continue;                               // a CRC match by chance must not reach the countdown
+        if (!found || (int16_t)(theRecord.sequence - settings_saved.sequence) > 0)
+        {
+            settings_saved = theRecord;
+            settings_slot = i;
+            found = 1;
+        }
+    }
+    if (found)
+    {
+        czas = settings_saved.czas;
+        drzemka = settings_saved.drzemka;
+        alarm_melody(alarm_ui, settings_saved.melody);
+    }
+    else
+    {
+        settings_saved.czas = czas;
+        settings_saved.drzemka = drzemka;
+        settings_saved.melody = alarms[alarm_ui].melody;
+    }
+}
+
+/*...........................................................................
+  Name:     settings_changed
+  Purpose:  schedule a save of the settings
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    every call restarts the delay, so a burst of changes is written once
+*/
+void settings_changed(void)
+{
+    settings_delay = settings_delay_s;
+}
+
+/*...........................................................................
+  Name:     settings_second
+  Purpose:  count down the save delay
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called by main() on every ev_Tick
+*/
+void settings_second(void)
+{
+    if (settings_delay && --settings_delay == 0)
+        settings_save();
+}
+
+/*...........................................................................
+  Name:     settings_save
+  Purpose:  append the current settings to the log
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    nothing is written if the settings match the newest record; the bytes are
+            written by EE_READY in the background (~3.4 mS each), so a save still in
+            progress postpones this one by a second
+*/
+void settings_save(void)
+{
+    if (settings_writing())
+    {
+        settings_delay = 1;
+        return;
+    }
+    if (czas == settings_saved.czas && drzemka == settings_saved.drzemka
+        && alarms[alarm_ui].melody == settings_saved.melody)
+        return;
+    settings_saved.sequence++;
+    if (settings_saved.sequence == settings_seq_erased)
+        settings_saved.sequence = 0;
+    settings_saved.czas = czas;
+    settings_saved.drzemka = drzemka;
+    settings_saved.melody = alarms[alarm_ui].melody;
+    settings_saved.crc = settings_crc(&settings_saved);
+    settings_slot = (settings_slot + 1 == settings_slots) ? 0 : settings_slot + 1;
+    settings_tx = settings_saved;
+    settings_tx_done = 0;
+    EECR |= (1<<EERIE);                             // EE_READY fires at once - the EEPROM is idle
+}
+
+/*...........................................................................
+  Name:     EE_READY_vect
+  Purpose:  write the next byte of settings_tx
+  Entry:    whenever the EEPROM is ready for another write while EERIE is set
+  Exit:     no parameters
+  Notes:    bytes that already hold the right value are skipped without a write cycle;
+            EEMPE must be followed by EEPE within four clock cycles, which holds here
+            because interrupts are disabled inside the handler
+*/
+ISR(EE_READY_vect)
+{
+    uint8_t *theAddress;
+    uint8_t theByte;
+
+    bench_isr(bench_EepromIsr);
+    while (settings_tx_done < sizeof(struct settings))
+    {
+        theAddress = (uint8_t *)&settings_log[settings_slot] + settings_tx_done;
+        theByte = ((uint8_t *)&settings_tx)[settings_tx_done++];
+        EEAR = (uintptr_t)theAddress;
+        hal_set_bits(EECR, 1<<EERE);
+        if (EEDR != theByte)
+        {
+            EEDR = theByte;
+            hal_set_bits(EECR, 1<<EEMPE);
+            hal_set_bits(EECR, 1<<EEPE);
+            bench_isr(bench_None);
+            return;
+        }
+    }
+    EECR &= ~(1<<EERIE);                            // the whole record is in the EEPROM
+    bench_isr(bench_None);
+}
+
+/*============================== Wall Clock ===============================*/
+/*
+  Name:     bcd_byte_increment
+  Purpose:  add one to a two-digit packed BCD value
+  Entry:    (theValue) is 0x00 - 0x98
+  Exit:     the new value
+*/
+uint8_t bcd_byte_increment(uint8_t theValue)
+{
+    if ((theValue & 0x0F) == 0x09)
+        return (theValue & 0xF0) + 0x10;
+    return theValue + 1;
+}
+
+/*...........................................................................
+  Name:     rtc_tick
+  Purpose:  advance the time of day by one second
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called from the tick interrupt; apart from the carries once a minute this is an
+            increment and a compare - the date and the next alarm are left to main()
+*/
+void rtc_tick(void)
+{
+    if (rtc_second != 0x59)
+    {
+        rtc_second = bcd_byte_increment(rtc_second);
+        return;
+    }
+    rtc_second = 0x00;
+    if (rtc_minute != 0x59)
+        rtc_minute = bcd_byte_increment(rtc_minute);
+    else
+    {
+        rtc_minute = 0x00;
+        if (rtc_hour != 0x23)
+            rtc_hour = bcd_byte_increment(rtc_hour);
+        else
+        {
+            rtc_hour = 0x00;                        // midnight
+            if (rtc_next_when == next_Tomorrow)
+                rtc_next_when = next_Today;
+            event_put(ev_NewDay);
+        }
+    }
+    if (rtc_next_when == next_Today && rtc_minute == rtc_next_minute && rtc_hour == rtc_next_hour)
+    {
+        rtc_fired_hour = rtc_next_hour;
+        rtc_fired_minute = rtc_next_minute;
+        event_put(ev_ClockAlarm);
+    }
+}
+
+/*...........................................................................
+  Name:     rtc_set_time
+  Purpose:  set the time of day
+  Entry:    (theHour), (theMinute), (theSecond) in packed BCD
+  Exit:     no parameters
+*/
+void rtc_set_time(uint8_t theHour, uint8_t theMinute, uint8_t theSecond)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        rtc_hour = theHour;
+        rtc_minute = theMinute;
+        rtc_second = theSecond;
+    }
+    clock_alarm_next();
+}
+
+/*...........................................................................
+  Name:     rtc_set_date
+  Purpose:  set the date
+  Entry:    (theYear) 0x00 - 0x99 for 2000 - 2099, (theMonth) 0x01 - 0x12, (theDay) 0x01 - 0x31
+            in packed BCD; (theWeekday) 0 = Monday ... 6 = Sunday, as rtc_weekday_of gives
+  Exit:     no parameters
+*/
+void rtc_set_date(uint8_t theYear, uint8_t theMonth, uint8_t theDay, uint8_t theWeekday)
+{
+    rtc_year = theYear;
+    rtc_month = theMonth;
+    rtc_day = theDay;
+    rtc_weekday = theWeekday;
+    clock_alarm_next();
+}
+
+/*...........................................................................
+  Name:     rtc_leap_year
+  Purpose:  tell whether a year has a 29th of February
+  Entry:    (theYear) 0x00 - 0x99 in packed BCD
+  Exit:     non-zero in a leap year
+  Notes:    a two-digit BCD year is divisible by 4 when the tens digit is even and the units
+            digit is 0, 4 or 8, or the tens digit is odd and the units digit is 2 or 6
+*/
+uint8_t rtc_leap_year(uint8_t theYear)
+{
+    uint8_t units = theYear & 0x0F;
+
+    if (theYear & 0x10)
+        return units == 2 || units == 6;
+    return units == 0 || units == 4 || units == 8;
+}
+
+/*...........................................................................
+  Name:     rtc_month_last
+  Purpose:  find the last day of a month
+  Entry:    (theYear) 0x00 - 0x99, (theMonth) 0x01 - 0x12, in packed BCD
+  Exit:     the last day in packed BCD, 0x28 - 0x31
+*/
+uint8_t rtc_month_last(uint8_t theYear, uint8_t theMonth)
+{
+    if (theMonth == 0x02 && rtc_leap_year(theYear))
+        return 0x29;
+    return pgm_read_byte(&month_days[bcd_to_seconds(theMonth) - 1]);
+}
+
+/*...........................................................................
+  Name:     rtc_weekday_of
+  Purpose:  work out the weekday of a date
+  Entry:    (theYear) 0x00 - 0x99, (theMonth) 0x01 - 0x12, (theDay) 0x01 - 0x31, in packed BCD
+  Exit:     0 = Monday ... 6 = Sunday
+  Notes:    Sakamoto's method - January and February count as the end of the year before;
+            the century terms are constant from 2000 to 2099 (1999 for early 2000 included)
+*/
+uint8_t rtc_weekday_of(uint8_t theYear, uint8_t theMonth, uint8_t theDay)
+{
+    uint16_t year = 2000 + bcd_to_seconds(theYear);
+    uint8_t month = bcd_to_seconds(theMonth);
+
+    if (month < 3)
+        year--;
+    return (year + year / 4 - year / 100 + year / 400 + pgm_read_byte(&month_weekday[month - 1])
+            + bcd_to_seconds(theDay) + 6) % 7;      // +6: the method counts from Sunday
+}
+
+/*...........................................................................
+  Name:     rtc_new_day
+  Purpose:  move the date and the weekday on by one day
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called by main() on ev_NewDay - the only place the calendar is worked out
+*/
+void rtc_new_day(void)
+{
+    uint8_t last = rtc_month_last(rtc_year, rtc_month);
+
+    rtc_weekday = (rtc_weekday == 6) ? 0 : rtc_weekday + 1;
+    if (rtc_day != last)
+    {
+        rtc_day = bcd_byte_increment(rtc_day);
+        return;
+    }
+    rtc_day = 0x01;
+    if (rtc_month != 0x12)
+    {
+        rtc_month = bcd_byte_increment(rtc_month);
+        return;
+    }
+    rtc_month = 0x01;
+    rtc_year = (rtc_year == 0x99) ? 0x00 : bcd_byte_increment(rtc_year);
+}
+
+/*...........................................................................
+  Name:     clock_alarm_set
+  Purpose:  configure a calendar alarm
+  Entry:    (theClockAlarm) 0 .. clock_alarm_count-1
+            (theHour), (theMinute) in packed BCD
+            (theWeekdays) day_ bits, 0 to disable
+            (theAlarm) the pool alarm used for its Ringing state, (theOutput) its PORTE bits
+  Exit:     no parameters
+*/
+void clock_alarm_set(uint8_t theClockAlarm, uint8_t theHour, uint8_t theMinute, uint8_t theWeekdays,
+                     uint8_t theAlarm, uint8_t theOutput)
+{
+    clock_alarms[theClockAlarm].hour = theHour;
+    clock_alarms[theClockAlarm].minute = theMinute;
+    clock_alarms[theClockAlarm].weekdays = theWeekdays;
+    clock_alarms[theClockAlarm].alarm = theAlarm;
+    clock_alarms[theClockAlarm].output = theOutput;
+    clock_alarm_next();
+}
+
+/*...........................................................................
+  Name:     clock_alarm_next
+  Purpose:  point the cursor at the first calendar alarm after the current minute
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    looks at the rest of today, then at tomorrow; packed BCD compares like binary
+*/
+void clock_alarm_next(void)
+{
+    uint8_t i;
+    uint8_t today = 1 << rtc_weekday;
+    uint8_t tomorrow = (rtc_weekday == 6) ? day_Monday : today << 1;
+    uint16_t now;
+    uint16_t at;
+    uint16_t best_today = 0xFFFF;
+    uint16_t best_tomorrow = 0xFFFF;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        now = (rtc_hour << 8) | rtc_minute;
+    }
+    for (i = 0; i < clock_alarm_count; i++)
+    {
+        at = (clock_alarms[i].hour << 8) | clock_alarms[i].minute;
+        if ((clock_alarms[i].weekdays & today) && at > now && at < best_today)
+            best_today = at;
+        if ((clock_alarms[i].weekdays & tomorrow) && at < best_tomorrow)
+            best_tomorrow = at;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (best_today != 0xFFFF)
+        {
+            rtc_next_hour = best_today >> 8;
+            rtc_next_minute = best_today & 0xFF;
+            rtc_next_when = next_Today;
+        }
+        else if (best_tomorrow != 0xFFFF)
+        {
+            rtc_next_hour = best_tomorrow >> 8;
+            rtc_next_minute = best_tomorrow & 0xFF;
+            rtc_next_when = next_Tomorrow;
+        }
+        else
+            rtc_next_when = next_None;
+    }
+}
+
+/*...........................................................................
+  Name:     clock_alarm_fire
+  Purpose:  ring every calendar alarm due at the minute that posted ev_ClockAlarm and move
+            the cursor on
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called by main() on ev_ClockAlarm; at midnight ev_NewDay comes first and has
+            already moved the cursor past 00:00, hence rtc_fired_hour and rtc_fired_minute
+*/
+void clock_alarm_fire(void)
+{
+    uint8_t i;
+    uint8_t today = 1 << rtc_weekday;
+    uint8_t h, m;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        h = rtc_fired_hour;
+        m = rtc_fired_minute;
+    }
+    for (i = 0; i < clock_alarm_count; i++)
+    {
+        if ((clock_alarms[i].weekdays & today) && clock_alarms[i].hour == h && clock_alarms[i].minute == m)
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                alarms[clock_alarms[i].alarm].output = clock_alarms[i].output;
+                alarm_ring(clock_alarms[i].alarm);
+            }
+        }
+    }
+    clock_alarm_next();
+}
+
+/*...........................................................................
+  Name:     clock_show
+  Purpose:  display the time of day as HH:MM:SS on line two
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    next to large digits there is room only for HH:MM on line one and :SS below it
+*/
+void clock_show(void)
+{
+    uint8_t text[9];
+    uint8_t h, m, sec;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        h = rtc_hour;
+        m = rtc_minute;
+        sec = rtc_second;
+    }
+    text[0] = bcd_char(h >> 4);
+    text[1] = bcd_char(h);
+    text[3] = bcd_char(m >> 4);
+    text[4] = bcd_char(m);
+    text[6] = bcd_char(sec >> 4);
+    text[7] = bcd_char(sec);
+    text[2] = text[5] = ':';
+    text[8] = 0;
+#ifdef lcd_big_digits
+    lcd_fb_goto(lcd_Columns - 5);
+    text[5] = 0;
+    lcd_fb_puts(text);                              // HH:MM
+    lcd_fb_goto(2 * lcd_Columns - 3);
+    text[5] = ':';
+    lcd_fb_puts(&text[5]);                          // :SS
+#else
+    lcd_fb_goto(lcd_Columns);
+    lcd_fb_puts(text);
+#endif
+    lcd_fb_flush();
+}
+
+/*============================== Countdown Timer ==========================*/
+/*
+  Name:     tick_init
+  Purpose:  set up the time base of the countdown
+  Entry:    Timer1: tick_OCR and tick_clock_select configured for a 1 second period
+            Timer2 (tick_rtc): a 32.768 kHz crystal on TOSC1/TOSC2
+            watchdog (tick_wdt): wdt_prescale for a wdt_period_s period
+  Exit:     no parameters
+  Notes:    Timer1 runs in CTC mode, which restarts the period in hardware on every compare
+            match, so the time spent updating the display is not added to every second
+            the crystal of Timer2 needs up to a second to settle after power-up
+            the tick is left stopped until tick_start()
+            the watchdog is calibrated in its first period, whatever an earlier run left
+*/
+void tick_init(void)
+{
+#ifdef tick_rtc
+    TIMSK2 = 0;
+    ASSR = (1<<AS2);                                // clock from the crystal on TOSC1/TOSC2
+    TCNT2 = 0;
+    TCCR2A = 0;                                     // normal mode, overflow every 256 counts
+    TCCR2B = rtc_clock_select;
+    while (ASSR & rtc_busy_mask);                   // wait until the settings reach the timer
+    TIFR2 = (1<<OCF2B)|(1<<OCF2A)|(1<<TOV2);
+#elif defined(tick_wdt)
+    MCUSR &= ~(1<<WDRF);                            // or WDE could not be cleared
+    TCCR1A = 0;
+    TCCR1B = 0;                                     // normal mode, stopped until a calibration
+    TIMSK1 = (1<<TOIE1);                            // count the overflows of a long period
+    wdt_phase = 0;
+    wdt_cal = 0;
+    wdt_until_cal = 1;                              // time the first period
+#else
+    TCCR1A = 0;
+    TCCR1B = (1<<WGM12);                            // CTC, TOP = OCR1A, clock stopped
+    OCR1A = tick_OCR;
+    TIMSK1 |= (1<<OCIE1A);                          // interrupt on every compare match
+#endif
+}
+
+/*...........................................................................
+  Name:     tick_start
+  Purpose:  begin a new full second and enable the tick interrupt
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called once at start-up - the wall clock keeps the tick running from then on
+*/
+void tick_start(void)
+{
+#ifdef tick_rtc
+    TCNT2 = 0;
+    GTCCR = (1<<PSRASY);                            // restart the prescaler as well
+    while (ASSR & (1<<TCN2UB));
+    TIFR2 = (1<<TOV2);                              // drop a stale overflow
+    TIMSK2 |= (1<<TOIE2);
+#elif defined(tick_wdt)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        wdt_reset();                                // start a full period
+        WDTCSR = (1<<WDCE)|(1<<WDE);                // timed sequence - 4 cycles to change
+        WDTCSR = (1<<WDIE)|wdt_prescale;            // interrupt only, no reset
+    }
+#else
+    TCNT1 = 0;
+    TIFR1 = (1<<OCF1A);                             // drop a stale compare match
+    TCCR1B |= tick_clock_select;                    // start the first second
+#endif
+}
+
+/*...........................................................................
+  Name:     tick_sync
+  Purpose:  make sure Timer2 can wake the CPU from the next power-save
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    after a Timer2 wake-up the asynchronous interrupt logic needs one TOSC cycle
+            before power-save may be entered again; writing a register and waiting for its
+            update-busy flag guarantees that (up to ~60 uS)
+*/
+void tick_sync(void)
+{
+#ifdef tick_rtc
+    OCR2B = 0;
+    while (ASSR & (1<<OCR2BUB));
+#endif
+}
+
+/*...........................................................................
+  Name:     sleep_mode_allowed
+  Purpose:  choose the deepest sleep mode that keeps every running peripheral working
+  Entry:    no parameters
+  Exit:     a SLEEP_MODE_ value for set_sleep_mode
+  Notes:    the LCD queue (Timer0), the button sampler (Timer3), the buzzer (Timer4), the
+            EEPROM ready interrupt, the USART and the Timer1 tick need the I/O clock, so they
+            allow only
+            idle - with the wall clock the Timer1 tick always runs, use tick_rtc for deeper
+            sleep; Timer2 keeps running in power-save; the watchdog wakes from power-down,
+            except while a calibration needs the crystal; a pin change wakes from any mode
+*/
+uint8_t sleep_mode_allowed(void)
+{
+    if (lcd_tx_busy() || lcd_i2c_busy() || buttons_sampling() || buzzer_playing() || settings_writing() || uart_awake)
+        return SLEEP_MODE_IDLE;
+#ifdef tick_rtc
+    return SLEEP_MODE_PWR_SAVE;
+#elif defined(tick_wdt)
+    if (wdt_cal)
+        return SLEEP_MODE_IDLE;
+    return SLEEP_MODE_PWR_DOWN;
+#else
+    if (tick_running())
+        return SLEEP_MODE_IDLE;
+    return SLEEP_MODE_PWR_DOWN;
+#endif
+}
+
+/*...........................................................................
+  Name:     countdown
+  Purpose:  start counting down from (czasomierz) seconds
+  Entry:    (czasomierz) is the number of seconds, packed BCD
+  Exit:     no parameters
+  Notes:    returns immediately; the tick interrupt counts the seconds and main() redraws
+            the display between sleeps
+*/
+void countdown(uint16_t czasomierz)
+{
+	countdown_stop();
+	odliczanie = czasomierz;
+	if (czasomierz == 0) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			alarm_ring(alarm_ui);
+		}
+		countdown_finish();
+		return;
+	}
+	countdown_show(czasomierz);
+	alarm_arm(alarm_ui, bcd_to_seconds(czasomierz), alarm_ui_output);
+}
+
+/*...........................................................................
+  Name:     countdown_stop
+  Purpose:  stop the countdown without firing the alarm
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+void countdown_stop(void)
+{
+	alarm_cancel(alarm_ui);
+}
+
+/*...........................................................................
+  Name:     countdown_show
+  Purpose:  display the number of seconds left
+  Entry:    (czasomierz) is the number of seconds, packed BCD
+  Exit:     no parameters
+*/
+void countdown_show(uint16_t czasomierz)
+{
+	ekran_gotowy = 1;
+	bench_main_begin(bench_Redraw);                 // ends when TIMER0_COMPA has emptied the queue
+#ifdef lcd_big_digits
+	lcd_fb_put_big_bcd(0, czasomierz);              // both lines, left of the clock
+#else
+	lcd_fb_goto(0);                                 // line one - line two keeps the clock
+	lcd_fb_put_bcd(czasomierz);
+#endif
+	lcd_fb_flush();                                 // send only the digits that changed
+}
+
+/*...........................................................................
+  Name:     countdown_finish
+  Purpose:  show "000" once the front panel alarm has fired
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+void countdown_finish(void)
+{
+		countdown_show(0x000);                  // czas zostaje - to zapisana nastawa
+}
+
+#ifdef tick_wdt
+// Przerwanie od watchdoga - uplynal okres wdt_period_s; sekundy liczone wg kalibracji
+ISR  (WDT_vect)
+{
+	probe_on();
+	bench_isr(bench_TickIsr);
+	wdt_calibrate();
+	wdt_phase += wdt_counts;
+	while (wdt_phase >= wdt_second_counts) {
+		wdt_phase -= wdt_second_counts;
+		sched_base += sched_period;
+		tick_second();
+	}
+	bench_isr(bench_None);
+	probe_off();
+}
+
+// Przepelnienie Timer1 podczas kalibracji (okres 8 s to ok. 2 przepelnienia)
+ISR  (TIMER1_OVF_vect)
+{
+	wdt_cal_overflows++;
+}
+
+/*...........................................................................
+  Name:     wdt_calibrate
+  Purpose:  time one watchdog period with Timer1 every wdt_calibrate_s seconds
+  Entry:    no parameters
+  Exit:     wdt_counts updated at the end of a timed period
+  Notes:    called by WDT_vect at the start of every period; the period before the timed
+            one is spent in idle, so both ends are stamped with the same wake-up latency
+*/
+void wdt_calibrate(void)
+{
+    uint32_t counts;
+
+    if (wdt_cal == wdt_cal_Timing)
+    {
+        TCCR1B = 0;                                 // stop, then read a still counter
+        counts = ((uint32_t)wdt_cal_overflows << 16) | TCNT1;
+        if (TIFR1 & (1<<TOV1))                      // an overflow not yet counted
+        {
+            counts += 0x10000UL;
+            TIFR1 = (1<<TOV1);
+        }
+        wdt_drift = counts - wdt_counts;
+        wdt_counts = counts;
+        wdt_cal = 0;
+        wdt_until_cal = wdt_calibrate_s / wdt_period_s;
+    }
+    else if (wdt_cal == wdt_cal_Armed)
+    {
+        TCNT1 = 0;
+        wdt_cal_overflows = 0;
+        TIFR1 = (1<<TOV1);
+        TCCR1B = wdt_clock_select;
+        wdt_cal = wdt_cal_Timing;
+    }
+    else if (--wdt_until_cal == 0)
+        wdt_cal = wdt_cal_Armed;                    // stay in idle through the next period
+}
+#else
+#ifdef tick_rtc
+// Przerwanie od Timer2 (zegar 32.768 kHz) - uplynela jedna sekunda
+ISR  (TIMER2_OVF_vect)
+#else
+// Przerwanie od Timer1 - uplynela jedna sekunda
+ISR  (TIMER1_COMPA_vect)
+#endif
+{
+	probe_on();
+	bench_isr(bench_TickIsr);
+	sched_base += sched_period;
+	tick_second();
+	bench_isr(bench_None);
+	probe_off();
+}
+#endif
+
+/*...........................................................................
+  Name:     tick_second
+  Purpose:  advance everything that counts seconds by one
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called by the tick interrupt
+*/
+void tick_second(void)
+{
+	rtc_tick();
+	alarm_tick();
+	uart_second();
+	event_put(ev_Tick);
+}
+
+/*============================== Serial Interface =========================*/
+/*
+  Name:     uart_init
+  Purpose:  set up USART0 and the RXD wake-up
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+void uart_init(void)
+{
+    UBRR0 = uart_UBRR;
+    UCSR0A = (1<<U2X0);
+    UCSR0C = (1<<UCSZ01)|(1<<UCSZ00);               // 8 data bits, no parity, 1 stop bit
+    UCSR0B = (1<<RXCIE0)|(1<<RXEN0)|(1<<TXEN0);
+    PCMSK2 |= (1<<PCINT16);                         // RXD
+    PCIFR = (1<<PCIF2);
+    PCICR |= (1<<PCIE2);
+}
+
+/*...........................................................................
+  Name:     uart_second
+  Purpose:  count down the time the serial link keeps the CPU out of deep sleep
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called from the tick interrupt; the RXD wake-up is re-armed when it runs out
+*/
+void uart_second(void)
+{
+    if (uart_awake && --uart_awake == 0)
+    {
+        PCIFR = (1<<PCIF2);
+        PCICR |= (1<<PCIE2);
+    }
+}
+
+// RXD falling edge - start bit while asleep
+ISR(PCINT2_vect)
+{
+    PCICR &= ~(1<<PCIE2);                           // the USART takes over until uart_awake runs out
+    uart_awake = uart_awake_s;
+}
+
+/*...........................................................................
+  Name:     USART0_RX_vect
+  Purpose:  store a received byte
+  Entry:    one byte in UDR0
+  Exit:     ev_Command at the end of a line
+*/
+ISR(USART0_RX_vect)
+{
+    uint8_t theByte;
+    uint8_t head = uart_rx_head;
+    uint8_t next = (head + 1) & (uart_rx_size - 1);
+
+    bench_isr(bench_UartIsr);
+    theByte = UDR0;
+    uart_awake = uart_awake_s;
+    if (next == uart_rx_tail)
+        uart_rx_dropped++;
+    else
+    {
+        uart_rx[head] = theByte;
+        uart_rx_head = next;
+        if (theByte == '\r' || theByte == '\n')
+            event_put(ev_Command);
+    }
+    bench_isr(bench_None);
+}
+
+/*...........................................................................
+  Name:     USART0_UDRE_vect
+  Purpose:  send the next queued byte
+  Entry:    the transmit buffer is empty
+  Exit:     no parameters
+  Notes:    switches itself off with the last byte
+*/
+ISR(USART0_UDRE_vect)
+{
+    uint8_t tail = uart_tx_tail;
+
+    bench_isr(bench_UartIsr);
+    if (tail == uart_tx_head)
+        UCSR0B &= ~(1<<UDRIE0);
+    else
+    {
+        UDR0 = uart_tx[tail];
+        uart_tx_tail = (tail + 1) & (uart_tx_size - 1);
+    }
+    bench_isr(bench_None);
+}
+
+/*...........................................................................
+  Name:     uart_putc
+  Purpose:  queue one byte for sending
+  Entry:    (theByte) is the byte
+  Exit:     no parameters
+  Notes:    call only from main(); sleeps in idle while the queue is full, like lcd_tx_put
+*/
+void uart_putc(uint8_t theByte)
+{
+    uint8_t head = uart_tx_head;
+    uint8_t next = (head + 1) & (uart_tx_size - 1);
+
+    while (next == uart_tx_tail)                    // full - USART0_UDRE will make room
+    {
+        cli();
+        if (next == uart_tx_tail)
+        {
+            set_sleep_mode(SLEEP_MODE_IDLE);
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+    }
+    uart_tx[head] = theByte;
+    uart_tx_head = next;
+    uart_awake = uart_awake_s;                      // keep the clock running until it is out
+    UCSR0B |= (1<<UDRIE0);
+}
+
+/*...........................................................................
+  Name:     uart_puts
+  Purpose:  queue a string
+  Entry:    (theString) is null terminated
+  Exit:     no parameters
+*/
+void uart_puts(uint8_t *theString)
+{
+    while (*theString)
+        uart_putc(*theString++);
+}
+
+/*...........................................................................
+  Name:     uart_puts_P
+  Purpose:  queue a string kept in flash
+  Entry:    (theString) is null terminated, declared PROGMEM or made with PSTR()
+  Exit:     no parameters
+*/
+void uart_puts_P(const char *theString)
+{
+    uint8_t c;
+
+    while ((c = pgm_read_byte(theString++)) != 0)
+        uart_putc(c);
+}
+
+/*...........................................................................
+  Name:     uart_put_hex
+  Purpose:  queue a number in hex - packed BCD comes out as decimal
+  Entry:    (theValue), (theDigits) 1 .. 4
+  Exit:     no parameters
+*/
+void uart_put_hex(uint16_t theValue, uint8_t theDigits)
+{
+    while (theDigits--)
+        uart_putc(pgm_read_byte(&hex_ascii[(theValue >> (theDigits * 4)) & 0x0F]));
+}
+
+/*...........................................................................
+  Name:     uart_get_hex
+  Purpose:  read a number in hex from the command line
+  Entry:    (thePos) is the index in uart_line of the first digit, spaces before it skipped
+            (theDigits) is the exact number of digits, (theValue) receives the number
+  Exit:     the index after the last digit, or 0 if the digits are missing or not hex
+*/
+uint8_t uart_get_hex(uint8_t thePos, uint8_t theDigits, uint16_t *theValue)
+{
+    uint8_t c;
+
+    while (thePos < uart_line_len && uart_line[thePos] == ' ')
+        thePos++;
+    *theValue = 0;
+    while (theDigits--)
+    {
+        if (thePos >= uart_line_len)
+            return 0;
+        c = uart_line[thePos++];
+        if (c >= '0' && c <= '9')
+            c -= '0';
+        else if (c >= 'A' && c <= 'F')
+            c -= 'A' - 10;
+        else if (c >= 'a' && c <= 'f')
+            c -= 'a' - 10;
+        else
+            return 0;
+        *theValue = (*theValue << 4) | c;
+    }
+    return thePos;
+}
+
+/*...........................................................................
+  Name:     uart_status
+  Purpose:  send a status line
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+void uart_status(void)
+{
+    uint16_t left;
+    uint8_t h, m, sec;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        left = odliczanie;
+        h = rtc_hour;
+        m = rtc_minute;
+        sec = rtc_second;
+    }
+    uart_puts_P(PSTR("S "));
+    uart_put_hex(czas, 3);
+    uart_putc(' ');
+    uart_put_hex(left, 3);
+    uart_putc(' ');
+    uart_putc(alarm_ringing(alarm_ui) ? 'A' : countdown_running() ? 'R' : 'I');
+    uart_putc(' ');
+    uart_put_hex(h, 2);
+    uart_put_hex(m, 2);
+    uart_put_hex(sec, 2);
+    uart_puts_P(PSTR("\r\n"));
+}
+
+/*...........................................................................
+  Name:     uart_command
+  Purpose:  collect received bytes into lines and execute them
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called by main() on ev_Command; an over-long line is cut at uart_line_size
+*/
+void uart_command(void)
+{
+    uint8_t tail = uart_rx_tail;
+    uint8_t theByte;
+
+    while (tail != uart_rx_head)
+    {
+        theByte = uart_rx[tail];
+        tail = (tail + 1) & (uart_rx_size - 1);
+        uart_rx_tail = tail;
+        if (theByte == '\r' || theByte == '\n')
+        {
+            if (uart_line_len)
+                uart_execute();
+            uart_line_len = 0;
+        }
+        else if (uart_line_len < uart_line_size)
+            uart_line[uart_line_len++] = theByte;
+    }
+}
+
+/*...........................................................................
+  Name:     uart_execute
+  Purpose:  carry out the command in uart_line and send the reply
+  Entry:    uart_line holds uart_line_len bytes
+  Exit:     no parameters
+*/
+void uart_execute(void)
+{
+    uint16_t a, b, c, d, e;
+    uint8_t pos;
+    uint8_t ok = 1;
+
+    switch (uart_line[0])
+    {
+        case '?':
+        uart_status();
+        return;
+        case 'C':
+        if ((ok = uart_get_hex(1, 3, &a) && bcd_valid(a, 3) && !countdown_running()))
+        {
+            czas = a;
+            countdown_show(czas);
+            settings_changed();
+        }
+        break;
+        case 'G':
+        if ((ok = !countdown_running() && !alarm_ringing(alarm_ui)))
+            countdown(czas);
+        break;
+        case 'X':
+        if (uart_get_hex(1, 1, &a) && a != alarm_ui)    // X a - a pool alarm of its own
+        {
+            if ((ok = a < alarm_count))
+            {
+                alarm_cancel(a);
+                alarm_silence(a);
+            }
+            break;
+        }
+        if (alarm_ringing(alarm_ui))
+            alarm_silence(alarm_ui);
+        else
+            countdown_stop();
+        countdown_show(czas);                       // back to the set time either way
+        break;
+        case 'T':                                   // BCD checked digit by digit, then compared like binary
+        if ((ok = (pos = uart_get_hex(1, 2, &a)) && uart_get_hex(pos, 4, &b) && bcd_valid(a, 2) && a <= 0x23
+                  && bcd_valid(b, 4) && (b >> 8) <= 0x59 && (b & 0xFF) <= 0x59))
+            rtc_set_time(a, b >> 8, b & 0xFF);
+        break;
+        case 'D':
+        if ((ok = (pos = uart_get_hex(1, 2, &a)) && (pos = uart_get_hex(pos, 4, &b))
+                  && uart_get_hex(pos, 1, &c) && c < 7 && bcd_valid(a, 2) && bcd_valid(b, 4)
+                  && (b >> 8) >= 0x01 && (b >> 8) <= 0x12 && (b & 0xFF) >= 0x01
+                  && (b & 0xFF) <= rtc_month_last(a, b >> 8) && c == rtc_weekday_of(a, b >> 8, b & 0xFF)))
+            rtc_set_date(a, b >> 8, b & 0xFF, c);
+        break;
+        case 'A':
+        if ((ok = (pos = uart_get_hex(1, 1, &a)) && a < clock_alarm_count && (pos = uart_get_hex(pos, 4, &b))
+                  && (pos = uart_get_hex(pos, 2, &c)) && (pos = uart_get_hex(pos, 1, &d)) && d < alarm_count
+                  && uart_get_hex(pos, 2, &e) && bcd_valid(b, 4) && (b >> 8) <= 0x23 && (b & 0xFF) <= 0x59
+                  && !(c & ~day_Every)))
+            clock_alarm_set(a, b >> 8, b & 0xFF, c, d, e);
+        break;
+        case 'P':                                   // re-armed only after X a, its bits may be low
+        if ((ok = (pos = uart_get_hex(1, 1, &a)) && a < alarm_count && a != alarm_ui
+                  && (pos = uart_get_hex(pos, 3, &b)) && bcd_valid(b, 3) && b
+                  && uart_get_hex(pos, 2, &c) && !alarm_ringing(a)))
+            alarm_arm(a, bcd_to_seconds(b), c);
+        break;
+        case 'R':
+        if ((ok = uart_get_hex(1, 1, &a) && a < alarm_count))
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                if (alarms[a].state & alarm_Armed)
+                    ok = 0;
+                else
+                    alarm_ring(a);
+            }
+        }
+        break;
+        case 'B':
+        if ((ok = (pos = uart_get_hex(1, 1, &a)) && a < alarm_count && uart_get_hex(pos, 1, &b)
+                  && b < sizeof(melodies) / sizeof(melodies[0])))
+        {
+            alarm_melody(a, b);
+            if (a == alarm_ui)
+                settings_changed();
+        }
+        break;
+        case 'N':
+        uart_puts_P(PSTR("N "));
+        uart_put_hex(ev_dropped, 2);
+        uart_putc(' ');
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            a = lcd_bus_writes;
+        }
+        uart_put_hex(a, 4);
+        uart_putc(' ');
+        uart_put_hex(uart_rx_dropped, 2);
+        uart_putc(' ');
+        uart_put_hex(lcd_cgram_uploads, 4);
+        uart_puts_P(PSTR("\r\n"));
+        return;
+        case 'M':
+        if ((ok = uart_get_hex(1, 2, &a)))
+        {
+            uart_period = a;
+            if (a)
+                sched_after(task_Status, sched_seconds(a));
+            else
+                sched_cancel(task_Status);
+        }
+        break;
+#ifdef trace_buffer
+        case 'L':
+        trace_dump();
+        break;
+#endif
+        case 'W':
+        uart_puts_P(PSTR("W "));
+        uart_put_hex(sched_wakeups_last, 4);
+        uart_putc(' ');
+        uart_put_hex(sched_dispatches_last, 4);
+        uart_putc(' ');
+        uart_put_hex(sched_overhead_n ? sched_overhead * sched_stamp_us / sched_overhead_n : 0, 4);
+        uart_puts_P(PSTR("\r\n"));
+        sched_overhead = 0;
+        sched_overhead_n = 0;
+        return;
+#ifdef tick_wdt
+        case 'O':
+        uart_puts_P(PSTR("O "));
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            a = wdt_counts >> 16;                   // 125000 with wdt_period_s 8
+            c = wdt_counts;
+            b = wdt_drift;
+        }
+        uart_put_hex(a, 1);
+        uart_put_hex(c, 4);
+        uart_putc(' ');
+        uart_put_hex(b, 4);
+        uart_puts_P(PSTR("\r\n"));
+        return;
+#endif
+        case 'K':
+        uart_puts_P(PSTR("K "));
+        uart_put_hex(stack_unused(), 4);
+        uart_puts_P(PSTR("\r\n"));
+        return;
+        default:
+        ok = 0;
+    }
+    if (ok)
+        uart_puts_P(PSTR("OK\r\n"));
+    else
+        uart_puts_P(PSTR("ERR\r\n"));
+}
+
+#ifdef trace_buffer
+/*============================== Trace Buffer =============================*/
+/*
+  Name:     trace_init
+  Purpose:  make sure TCNT1 counts for the timestamps
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+void trace_init(void)
+{
+#ifdef tick_rtc
+    TCCR1A = 0;
+    TCCR1B = (1<<CS12);                             // normal mode, F_CPU / 256
+#endif
+}
+
+/*...........................................................................
+  Name:     trace_put
+  Purpose:  append a record to the trace buffer, overwriting the oldest
+  Entry:    (theCode) is a trace_ code, (theData) its argument
+  Exit:     no parameters
+  Notes:    callable from interrupt handlers and from main(); about 25 clock cycles
+*/
+void trace_put(uint8_t theCode, uint8_t theData)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (trace_on)
+        {
+            trace_log[trace_head].code = theCode;
+            trace_log[trace_head].data = theData;
+            trace_log[trace_head].time = TCNT1;
+            trace_head = (trace_head + 1) & (trace_size - 1);
+        }
+    }
+}
+
+/*...........................................................................
+  Name:     trace_dump
+  Purpose:  send the trace buffer over the serial link, oldest record first
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    recording is paused meanwhile, so the dump does not trace itself; never-used
+            records (code 0) are skipped
+*/
+void trace_dump(void)
+{
+    uint8_t i;
+    uint8_t theRecord;
+
+    trace_on = 0;
+    theRecord = trace_head;
+    for (i = 0; i < trace_size; i++)
+    {
+        if (trace_log[theRecord].code)
+        {
+            uart_puts_P(PSTR("L "));
+            uart_put_hex(trace_log[theRecord].code, 2);
+            uart_putc(' ');
+            uart_put_hex(trace_log[theRecord].data, 2);
+            uart_putc(' ');
+            uart_put_hex(trace_log[theRecord].time, 4);
+            uart_puts_P(PSTR("\r\n"));
+        }
+        theRecord = (theRecord + 1) & (trace_size - 1);
+    }
+    trace_on = 1;
+}
+
+#endif
+/*============================== Stack Check ==============================*/
+/*
+  Name:     stack_paint_ram
+  Purpose:  fill the unused RAM with stack_paint
+  Entry:    runs from .init1, before the C runtime has set anything up
+  Exit:     falls through to .init2
+  Notes:    written in assembler because there is no valid stack or zero register yet;
+            it stops below the top of RAM, where the reset already left the stack pointer
+*/
+#ifdef __AVR__
+void stack_paint_ram(void)
+{
+    __asm volatile (
+        "    ldi r30, lo8(_end)        \n"
+        "    ldi r31, hi8(_end)        \n"
+        "    ldi r24, %0               \n"
+        "    ldi r25, hi8(__stack)     \n"
+        "    rjmp 2f                   \n"
+        "1:  st Z+, r24                \n"
+        "2:  cpi r30, lo8(__stack)     \n"
+        "    cpc r31, r25              \n"
+        "    brlo 1b                   \n"
+        : : "i" (stack_paint));
+}
+#endif
+
+/*...........................................................................
+  Name:     stack_unused
+  Purpose:  measure the stack that has never been used since reset
+  Entry:    no parameters
+  Exit:     the number of bytes above the end of .bss still holding stack_paint
+  Notes:    a value saved on the stack that happens to equal stack_paint would be counted
+            as unused, so treat the result as accurate to a byte or two; the host build has
+            no painted RAM and reports 0
+*/
+uint16_t stack_unused(void)
+{
+#ifndef __AVR__
+    return 0;
+#else
+    extern uint8_t _end;
+    extern uint8_t __stack;
+    uint8_t *p = &_end;
+
+    while (p <= &__stack && *p == stack_paint)
+        p++;
+    return p - &_end;
+#endif
+}
+
+/*============================== Event Queue ==============================*/
+/*
+  Name:     event_put
+  Purpose:  append an event to the queue
+  Entry:    (theEvent) is one of the ev_ codes
+  Exit:     no parameters
+  Notes:    call only from interrupt handlers, or from main() with interrupts disabled -
+            handlers do not nest, so they act as a single producer and no locking is
+            needed; a full queue drops the event
+*/
+void event_put(uint8_t theEvent)
+{
+    uint8_t head = ev_head;
+    uint8_t next = (head + 1) & (ev_queue_size - 1);
+
+    trace(trace_Event, theEvent);
+    if (next == ev_tail)                            // full - keep the older events
+    {
+        ev_dropped++;
+        return;
+    }
+    ev_queue[head] = theEvent;
+    ev_head = next;                                 // publish only after the slot is written
+    sched_ready |= 1<<task_Events;                  // handlers do not nest - no lock needed
+}
+
+/*...........................................................................
+  Name:     event_get
+  Purpose:  remove the oldest event from the queue
+  Entry:    no parameters
+  Exit:     the event, or ev_None if the queue is empty
+  Notes:    call only from main() (the single consumer)
+*/
+uint8_t event_get(void)
+{
+    uint8_t tail = ev_tail;
+    uint8_t theEvent;
+
+    if (tail == ev_head)
+        return ev_None;
+    theEvent = ev_queue[tail];
+    ev_tail = (tail + 1) & (ev_queue_size - 1);     // free the slot only after it is read
+    return theEvent;
+}
+
+/*============================== Scheduler ================================*/
+void (* const sched_tasks[sched_task_count])(void) PROGMEM =
+{
+    task_events,                                    // task_Events
+    task_second,                                    // task_Second
+    task_status,                                    // task_Status
+};
+
+/*
+  Name:     sched_init
+  Purpose:  start the scheduler clock and the dispatch stamp
+  Entry:    tick_init has set up the tick timer
+  Exit:     no parameters
+  Notes:    with tick_rtc Timer1 is left running free at F_CPU / 256 to stamp the
+            dispatches; it stops in power-save, so it costs current only in idle
+*/
+void sched_init(void)
+{
+#ifdef tick_rtc
+    TCCR1A = 0;
+    TCCR1B = (1<<CS12);                             // normal mode, F_CPU / 256
+#endif
+    sched_base = 0;
+    sched_ready = 0;
+    sched_delayed = 0;
+}
+
+/*...........................................................................
+  Name:     sched_post
+  Purpose:  make a task ready to run
+  Entry:    (theTask) is one of the task_ numbers
+  Exit:     no parameters
+  Notes:    callable from interrupt handlers and from main()
+*/
+void sched_post(uint8_t theTask)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        sched_ready |= 1<<theTask;
+    }
+}
+
+/*...........................................................................
+  Name:     sched_after
+  Purpose:  run a task once (theCounts) from now
+  Entry:    (theTask) is one of the task_ numbers, (theCounts) a delay from sched_ms or
+            sched_seconds (below 2^31 counts - 9.5 hours)
+  Exit:     no parameters
+  Notes:    call only from main(); replaces an earlier deadline of the same task
+*/
+void sched_after(uint8_t theTask, uint32_t theCounts)
+{
+    sched_due[theTask] = sched_now() + theCounts;
+    sched_delayed |= 1<<theTask;
+}
+
+/*...........................................................................
+  Name:     sched_cancel
+  Purpose:  drop the deadline of a task
+  Entry:    (theTask) is one of the task_ numbers
+  Exit:     no parameters
+  Notes:    call only from main(); a task already made ready still runs
+*/
+void sched_cancel(uint8_t theTask)
+{
+    sched_delayed &= ~(1<<theTask);
+}
+
+/*...........................................................................
+  Name:     sched_now
+  Purpose:  read the scheduler clock
+  Entry:    no parameters
+  Exit:     sched_period counts since reset, wrapping at 2^32
+  Notes:    a tick that has come but whose handler has not run yet is counted in
+*/
+uint32_t sched_now(void)
+{
+    uint32_t base;
+    uint16_t count;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        base = sched_base;
+        count = sched_count();
+        if (sched_tick_pending() && (count = sched_count()) < sched_period / 2)
+            base += sched_period;                   // the counter has already wrapped
+    }
+    return base + count;
+}
+
+/*...........................................................................
+  Name:     sched_run
+  Purpose:  run the first ready task, or sleep until something is due
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    called by main() forever; each call either dispatches one task or sleeps once,
+            so task_Events, the lowest number, is always looked at first
+            the compare B wake-up is armed only for a deadline within the next second -
+            the seconds tick wakes the CPU anyway and the next call looks again; tick_sync
+            waits with the interrupts disabled, just before the sleep, so a dispatch does
+            not pay for it
+*/
+void sched_run(void)
+{
+    uint16_t start = TCNT1;
+    uint16_t spent;
+    uint32_t now = sched_now();
+    uint32_t wait = sched_period;                   // no deadline before the next tick
+    uint32_t left;
+    uint8_t ready = 0;
+    uint8_t theTask;
+    uint8_t bit;
+
+    for (theTask = 0, bit = 1; theTask < sched_task_count; theTask++, bit <<= 1)
+    {
+        if (!(sched_delayed & bit))
+            continue;
+        left = sched_due[theTask] - now;
+        if ((int32_t)left <= sched_margin)          // due, or too close to sleep for
+        {
+            sched_delayed &= ~bit;
+            ready |= bit;
+        }
+        else if (left < wait)
+            wait = left;
+    }
+
+    cli();
+    ready = (sched_ready |= ready);
+    if (ready)
+    {
+        for (theTask = 0, bit = 1; !(ready & bit); theTask++, bit <<= 1);
+        sched_ready = ready & ~bit;
+        sei();
+        spent = TCNT1;
+        if (spent < start)
+            spent -= sched_stamp_gap;               // Timer1 has wrapped
+        spent -= start;
+        sched_overhead += spent;
+        sched_overhead_n++;
+        sched_dispatches++;
+        ((void (*)(void))pgm_read_ptr(&sched_tasks[theTask]))();
+        return;
+    }
+
+#ifndef tick_wdt
+    if (wait < sched_period)                        // wake up for the deadline
+    {
+        left = sched_count() + wait;
+        if (left >= sched_period)
+            left -= sched_period;
+#ifdef tick_rtc
+        OCR2A = left;
+        while (ASSR & (1<<OCR2AUB));
+        TIFR2 = (1<<OCF2A);
+        TIMSK2 |= (1<<OCIE2A);
+#else
+        OCR1B = left;
+        TIFR1 = (1<<OCF1B);
+        TIMSK1 |= (1<<OCIE1B);
+#endif
+    }
+#endif
+    tick_sync();                                    // only before a sleep - a dispatch does not need it
+    // sei() tuz przed sleep_cpu() gwarantuje, ze przerwanie po sprawdzeniu nie zostanie przespane
+    set_sleep_mode(sleep_mode_allowed());           // najglebszy tryb, w ktorym dzialaja uzywane timery
+    sleep_enable();
+    bench_sleep(bench_Sleep);
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    bench_sleep(bench_None);
+    sched_wakeups++;
+}
+
+#ifdef tick_rtc
+// Przerwanie od Timer2 - termin zadania; samo wybudzenie wystarczy
+ISR  (TIMER2_COMPA_vect)
+{
+	TIMSK2 &= ~(1<<OCIE2A);
+}
+#elif !defined(tick_wdt)
+// Przerwanie od Timer1 - termin zadania; samo wybudzenie wystarczy
+ISR  (TIMER1_COMPB_vect)
+{
+	TIMSK1 &= ~(1<<OCIE1B);
+}
+#endif
+
+/*...........................................................................
+  Name:     task_events
+  Purpose:  handle the events queued by the interrupt handlers
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+void task_events(void)
+{
+	uint8_t zdarzenie;
+
+	while ((zdarzenie = event_get()) != ev_None) {
+		switch (zdarzenie & ev_TypeMask) {
+			case ev_Buttons:
+			// Wcisniecie lub powtorzenie - drgania stykow odfiltrowane w TIMER3_COMPA
+			buttons_pressed(zdarzenie & buttons_mask);
+			break;
+			case ev_LongPress:
+			buttons_long(zdarzenie & buttons_mask);
+			break;
+			case ev_Released:
+			break;
+			case ev_Tick:
+			sched_post(task_Second);
+			break;
+			case ev_Command:
+			uart_command();
+			break;
+			case ev_Done:
+			countdown_finish();
+			break;
+			case ev_LcdIdle:
+			// Ramka w calosci na wyswietlaczu; pierwsza rysowana dopiero po sekwencji resetu
+			if (!ekran_gotowy)
+				countdown_show(czas);
+			break;
+			case ev_ClockAlarm:
+			clock_alarm_fire();
+			break;
+			case ev_NewDay:
+			// Data i dzien tygodnia liczone tylko raz na dobe
+			rtc_new_day();
+			clock_alarm_next();
+			break;
+		}
+	}
+}
+
+/*...........................................................................
+  Name:     task_second
+  Purpose:  the work done once per second
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+void task_second(void)
+{
+	uint16_t pozostalo;
+
+	// Kolejna sekunda odliczania i zegara
+	if (countdown_running()) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			pozostalo = odliczanie;
+		}
+		countdown_show(pozostalo);
+	}
+	clock_show();
+	settings_second();
+	sched_wakeups_last = sched_wakeups;
+	sched_dispatches_last = sched_dispatches;
+	sched_wakeups = 0;
+	sched_dispatches = 0;
+}
+
+/*...........................................................................
+  Name:     task_status
+  Purpose:  send the periodic status line
+  Entry:    no parameters
+  Exit:     no parameters
+*/
+void task_status(void)
+{
+	uart_status();
+	if (uart_period)
+		sched_after(task_Status, sched_seconds(uart_period));
+}
+
+/*============================== Buttons ==================================*/
+/*
+  Name:     buttons_init
+  Purpose:  set up Timer3 as the button sampler
+  Entry:    no parameters
+  Exit:     no parameters
+  Notes:    the sampler is left stopped until PCINT1 sees the first edge
+*/
+void buttons_init(void)
+{
+    TCCR3A = 0;
+    TCCR3B = (1<<WGM32);                            // CTC, TOP = OCR3A, clock stopped
+    OCR3A = buttons_OCR;
+    TIMSK3 |= (1<<OCIE3A);
+    buttons_ct0 = 0xFF;                             // counts start at 3: four differing samples to accept
+    buttons_ct1 = 0xFF;
+}
+
+// Funkcja obslugujaca przerwania od przyciskow - tylko uruchomienie probkowania
+ISR  (PCINT1_vect)
+{
+	probe_on();
+	bench_sleep(bench_None);                        // PCINT edge -> here = wake-up + interrupt latency
+	bench_isr(bench_ButtonIsr);
+	PCICR &= ~(1 << PCIE1);		// drgania stykow obsluguje juz probkowanie
+	TCNT3 = 0;
+	TIFR3 = (1 << OCF3A);
+	TCCR3B |= buttons_clock_select;
+	bench_isr(bench_None);
+	probe_off();
+}
+
+/*...........................................................................
+  Name:     TIMER3_COMPA_vect
+  Purpose:  sample and debounce the buttons
+  Entry:    every 8 mS while the sampler runs
+  Exit:     ev_Buttons on a press and on every auto-repeat of S2/S3, ev_LongPress when another
+            button is held, ev_Released on a release
+  Notes:    each bit of buttons_ct1:buttons_ct0 counts the samples that differ from the
+            debounced level of one button and is reset by a sample that agrees, so all four
+            buttons are debounced with a handful of logic instructions
+            the repeat interval shrinks by a quarter after each repeat, so a held S2 reaches
+            full speed after about a second
+*/
+ISR(TIMER3_COMPA_vect)
+{
+    uint8_t raw;
+    uint8_t changed;
+
+    probe_on();
+    bench_isr(bench_SampleIsr);
+    raw = ~hal_read(PINC) & buttons_mask;
+    changed = buttons_state ^ raw;
+    buttons_ct0 = ~(buttons_ct0 & changed);
+    buttons_ct1 = buttons_ct0 ^ (buttons_ct1 & changed);
+    changed &= buttons_ct0 & buttons_ct1;           // counted to 4 - accept the new level
+    buttons_state ^= changed;
+    if (changed)
+    {
+        if (changed & buttons_state)
+            event_put(ev_Buttons | (changed & buttons_state));
+        if (changed & ~buttons_state)
+            event_put(ev_Released | (changed & ~buttons_state));
+        buttons_wait = (buttons_state & buttons_repeat_mask) ? buttons_repeat_first : buttons_long_samples;
+        buttons_repeat = buttons_repeat_start;
+    }
+    else if (buttons_state && buttons_wait && --buttons_wait == 0)
+    {
+        if (buttons_state & buttons_repeat_mask)
+        {
+            event_put(ev_Buttons | (buttons_state & buttons_repeat_mask));
+            buttons_wait = buttons_repeat;
+            buttons_repeat -= buttons_repeat >> 2;
+            if (buttons_repeat < buttons_repeat_min)
+                buttons_repeat = buttons_repeat_min;
+        }
+        else
+            event_put(ev_LongPress | buttons_state);    // once per hold - buttons_wait stays 0
+    }
+    if (!buttons_state && !raw)                     // all released and settled - back to pin change
+    {
+        TCCR3B &= ~buttons_clock_mask;
+        PCIFR = (1 << PCIF1);
+        PCICR |= (1 << PCIE1);
+    }
+    bench_isr(bench_None);
+    probe_off();
+}
+
+// Obsluga wcisnietych przyciskow (wywolywana z main)
+void buttons_pressed(uint8_t pressed)
+{
+	// Przycisk S1:
+	// Odpalenie lub wylaczenie buzzera
+	if (pressed & 0x01){
+		if (alarm_ringing(alarm_ui)){
+			alarm_silence(alarm_ui);
+			countdown_show(czas);           // powrot do nastawy
+		}
+		else if (countdown_running()) {
+			countdown_stop();                   // S1 w trakcie odliczania - przerwanie
+			countdown_show(czas);           // powrot do nastawy
+		}
+		else {
+			countdown(czas);
+		}
+	}
+	
+	//Przycisk S2:
+	//Zwiekszenie czasu o 1
+	if ((pressed & 0x02) && !countdown_running()){
+		czas = bcd_increment(czas);
+		countdown_show(czas);
+		settings_changed();
+	}
+	// Przycisk S4:
+	//Drzemeczka
+	else if (pressed & 0x08){
+		if (alarm_ringing(alarm_ui)){
+			alarm_silence(alarm_ui);
+			countdown(drzemka);
+		}
+	}
+	//Przycisk S3:
+	// Zmniejszenie czasu o 1
+	else if ((pressed & 0x04) && !countdown_running())
+	{
+		czas = bcd_decrement(czas);
+		countdown_show(czas);
+		settings_changed();
+	}
+}
+
+// Obsluga przytrzymanych przyciskow (wywolywana z main)
+void buttons_long(uint8_t held)
+{
+	// Przycisk S4 przytrzymany poza odliczaniem:
+	// Powrot do czasu domyslnego
+	if ((held & 0x08) && !countdown_running() && !alarm_ringing(alarm_ui)){
+		czas = time_default;
+		countdown_show(czas);
+		settings_changed();
+	}
+}
+/******************************* Main Program Code *************************/
+int main(void)
+{
+	hal_write(DDRE, 0xff); //Set port E as output
+	hal_write(DDRC, 0x00); //Set port C as input
+	hal_write(PORTC, 0xff); //Set pull-ups on port C
+	hal_write(PORTE, 0xff); //set port E as 1
+#ifdef lcd_i2c
+	lcd_i2c_init();                                 // the LCD pins are on the PCF8574
+#else
+	// configure the microprocessor pins for the data lines
+	hal_set_bits(lcd_D7_ddr, 1<<lcd_D7_bit);        // 4 data lines - output
+	hal_set_bits(lcd_D6_ddr, 1<<lcd_D6_bit);
+	hal_set_bits(lcd_D5_ddr, 1<<lcd_D5_bit);
+	hal_set_bits(lcd_D4_ddr, 1<<lcd_D4_bit);
+
+	// configure the microprocessor pins for the control lines
+	hal_set_bits(lcd_E_ddr, 1<<lcd_E_bit);          // E line - output
+	hal_set_bits(lcd_RS_ddr, 1<<lcd_RS_bit);        // RS line - output
+#ifdef lcd_use_busy_flag
+	hal_set_bits(lcd_RW_ddr, 1<<lcd_RW_bit);        // RW line - output
+#endif
+#endif
+
+	// initialize the LCD controller as determined by the defines (LCD instructions)
+	lcd_tx_init();                                  // from here on the LCD is written in the background
+	lcd_init_4d();                                  // queue the 4-bit reset sequence, ~110 mS to run
+
+	// display the first line of information - sent once the reset sequence has run
+	lcd_fb_init();                                  // the display will have just been cleared
+	settings_load();                                // czas and the rest from the EEPROM log
+
+	tick_init();                                    // countdown and wall clock time base
+	sched_init();
+	tick_start();
+	buttons_init();                                 // debounce sampler, started by PCINT1
+	buzzer_init();                                  // alarm melodies, started by alarm_ring
+	uart_init();                                    // serial commands and status
+#ifdef trace_buffer
+	trace_init();
+#endif
+#ifdef isr_probe
+	hal_set_bits(isr_probe_ddr, 1<<isr_probe_bit);
+#endif
+	
+
+// Wlaczenie przerwan
+PCICR |= (1 << PCIE1);		// Wlaczenie przerwan zewnetrznych
+PCMSK1 |= (1 << PCINT8);	// Przycisk S1
+PCMSK1 |= (1 << PCINT9);	// Przycisk S2
+PCMSK1 |= (1 << PCINT10);	// Przycisk S3
+PCMSK1 |= (1 << PCINT11);	// Przycisk S4
+ cli();
+ sei();
+	// the first frame waits for ev_LcdIdle at the end of the reset sequence: with its CGRAM
+	//   uploads it does not fit in the queue beside it, and lcd_tx_put would sleep here
+	//   for ~110 mS with the buttons and the serial commands not yet handled
+    while(1){
+		// Zadania uruchamiane przez planiste; gdy zadne nie czeka - uspienie
+		sched_run();
+  }
+    return 0;
+}
+
+
+
+
+
+
+
+
+
+
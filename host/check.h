@@ -0,0 +1,61 @@
+/*
+  Minimal test harness for the host tests - each case runs in a child process, so every
+  case boots the firmware from its power-on state (static data included)
+*/
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+struct check_case {
+    const char *name;
+    void (*run)(void);
+};
+
+static int check_failures;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+                        check_failures++; } } while (0)
+#define CHECK_EQ(a, b) \
+    do { long long check_a = (long long)(a), check_b = (long long)(b); \
+         if (check_a != check_b) { fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: 0x%llX != 0x%llX\n", \
+                                           __FILE__, __LINE__, #a, #b, check_a, check_b); \
+                                   check_failures++; } } while (0)
+
+static inline int check_all(const struct check_case *theCases, size_t theCount)
+{
+    size_t i;
+    int failed = 0;
+
+    for (i = 0; i < theCount; i++)
+    {
+        int status = 0;
+        pid_t pid;
+
+        fflush(stdout);
+        fflush(stderr);
+        if ((pid = fork()) == 0)
+        {
+            theCases[i].run();
+            fflush(stdout);
+            _exit(check_failures ? 1 : 0);
+        }
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            printf("ok   %s\n", theCases[i].name);
+        else
+        {
+            printf("FAIL %s\n", theCases[i].name);
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+#define check_count(cases)  (sizeof(cases) / sizeof((cases)[0]))
+
+#endif
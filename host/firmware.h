@@ -0,0 +1,91 @@
+/*
+  The firmware built for the host
+
+  hal.h comes first, so the firmware takes its hardware access layer from the simulator, and
+  the firmware source follows with main() renamed; a host program includes this header once
+  and calls firmware_boot() to power up the simulated board and run the firmware on it.
+  Build options such as tick_rtc are passed with -D, as for the AVR build.
+*/
+#ifndef HOST_FIRMWARE_H
+#define HOST_FIRMWARE_H
+
+#include "hal.h"
+#include "hd44780.h"
+#include "pcf8574.h"
+#include <string.h>
+
+#define main firmware_main
+#include "../Projekt_mikroprocesory_Olbrych_Moskala.c"
+#undef main
+
+#define firmware_S1         0x01                    // sim_buttons bits
+#define firmware_S2         0x02
+#define firmware_S3         0x04
+#define firmware_S4         0x08
+
+// the board powered, the firmware not yet started - the EEPROM can be filled in between
+static inline void firmware_power_on(void)
+{
+    sim_init(F_CPU);
+#ifdef lcd_i2c
+    pcf8574_attach(lcd_i2c_address);                // RS = P0, E = P2, D4..D7 = P4..P7
+    hd44780_attach(&pcf8574.port, lcd_RS_bit, &pcf8574.port, lcd_E_bit, &pcf8574.port, 4);
+#else
+    hd44780_attach(&lcd_RS_port, lcd_RS_bit, &lcd_E_port, lcd_E_bit, &lcd_D4_port, lcd_D4_bit);
+#endif
+#ifdef lcd_use_busy_flag
+    hd44780_attach_rw(&lcd_RW_port, lcd_RW_bit);
+#endif
+}
+
+static inline void firmware_boot(void)
+{
+    firmware_power_on();
+    sim_start(firmware_main);
+}
+
+// the LCD shows what the firmware meant to draw and nothing is left to send
+static inline int firmware_lcd_settled(void)
+{
+    uint8_t i;
+
+    if (lcd_tx_busy() || hd44780_busy())
+        return 0;
+    for (i = 0; i < lcd_Cells; i++)
+        if (hd44780_cell(i / lcd_Columns, i % lcd_Columns) != lcd_shadow[i])
+            return 0;
+    return 1;
+}
+
+// a line the firmware has sent since sim_uart_clear
+static inline int firmware_replied(void)
+{
+    return memchr(sim_uart_out, '\n', sim_uart_out_len) != NULL;
+}
+
+// type one command on the serial line and return the first reply line, without CR LF ("" if
+//   none came within 200 mS); a lone CR goes first, in case the start bit that wakes the CPU
+//   from a deep sleep is lost
+static inline const char *firmware_command(const char *theLine)
+{
+    static char reply[80];
+    size_t n;
+
+    sim_uart_rx("\r", 1);
+    sim_run(sim_ms(5));
+    sim_uart_clear();
+    sim_uart_rx(theLine, strlen(theLine));
+    sim_uart_rx("\r", 1);
+    reply[0] = 0;
+    if (sim_run_until(firmware_replied, sim_ms(200)))
+    {
+        n = strcspn(sim_uart_out, "\r\n");
+        if (n >= sizeof(reply))
+            n = sizeof(reply) - 1;
+        memcpy(reply, sim_uart_out, n);
+        reply[n] = 0;
+    }
+    return reply;
+}
+
+#endif
@@ -0,0 +1,17 @@
+/*
+  Host definitions of the firmware's hardware access layer - included before the firmware
+  source, so its own #ifndef hal_read block is skipped.  Port writes reach the simulated
+  peripherals (and the HD44780 model) and cost two CPU cycles of virtual time; delays are
+  charged to virtual time instead of spinning.
+*/
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include "sim.h"
+
+#define hal_read(reg)               (reg)
+#define hal_write(reg, value)       sim_hal_write(&(reg), (value))
+#define hal_delay_us(t)             sim_delay_us(t)
+#define hal_delay_ms(t)             sim_delay_us((t) * 1000.0)
+
+#endif
@@ -0,0 +1,394 @@
+/*
+  HD44780 model for the host build - see hd44780.h
+*/
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include "hd44780.h"
+
+// datasheet timing (5 V, fosc 270 kHz)
+#define hd_power_on         sim_ms(40)              // after Vcc rises to 2.7 V
+#define hd_reset_first      sim_us(4100)            // after the first 8-bit Function Set
+#define hd_reset_second     sim_us(100)             // after the second
+#define hd_exec             sim_us(37)              // most instructions and data writes
+#define hd_exec_slow        sim_us(1520)            // Clear Display, Return Home
+#define hd_tAS              sim_us(0.040)           // RS set-up before E rises
+#define hd_tAH              sim_us(0.010)           // RS hold after E falls
+#define hd_PWEH             sim_us(0.230)           // E high
+#define hd_tcycE            sim_us(0.500)           // E rise to E rise
+#define hd_tDSW             sim_us(0.080)           // data set-up before E falls
+#define hd_tH               sim_us(0.010)           // data hold after E falls
+
+struct hd44780 hd44780;
+
+static volatile uint8_t *rs_port, *e_port, *d_port, *rw_port;
+static uint8_t rs_bit, e_bit, d4_bit, rw_bit;
+
+static void violation(const char *theFormat, ...)
+{
+    va_list args;
+    int n;
+
+    if (!hd44780.violations++)
+    {
+        n = snprintf(hd44780.first_violation, sizeof(hd44780.first_violation), "%.3f uS: ", sim_to_us(sim_now));
+        va_start(args, theFormat);
+        vsnprintf(hd44780.first_violation + n, sizeof(hd44780.first_violation) - n, theFormat, args);
+        va_end(args);
+    }
+}
+
+// DDRAM index of an address, 0xFF if the address does not exist
+static uint8_t ddram_index(uint8_t theAddress)
+{
+    if (!hd44780.two_lines)
+        return (theAddress < 80) ? theAddress : 0xFF;
+    if (theAddress < 40)
+        return theAddress;
+    if (theAddress >= 0x40 && theAddress < 0x40 + 40)
+        return theAddress - 0x40 + 40;
+    return 0xFF;
+}
+
+static void ac_step(void)
+{
+    if (hd44780.to_cgram)
+    {
+        hd44780.ac = (hd44780.ac + (hd44780.increment ? 1 : -1)) & 0x3F;
+        return;
+    }
+    if (hd44780.increment)
+    {
+        if (!hd44780.two_lines)
+            hd44780.ac = (hd44780.ac == 79) ? 0 : hd44780.ac + 1;
+        else if (hd44780.ac == 0x27)                // line one runs into line two ...
+            hd44780.ac = 0x40;
+        else if (hd44780.ac == 0x67)                // ... and line two back into line one
+            hd44780.ac = 0x00;
+        else
+            hd44780.ac++;
+    }
+    else
+    {
+        if (!hd44780.two_lines)
+            hd44780.ac = hd44780.ac ? hd44780.ac - 1 : 79;
+        else if (hd44780.ac == 0x40)
+            hd44780.ac = 0x27;
+        else if (hd44780.ac == 0x00)
+            hd44780.ac = 0x67;
+        else
+            hd44780.ac--;
+    }
+}
+
+static void instruction(uint8_t theByte)
+{
+    sim_time_t exec = hd_exec;
+
+    hd44780.instructions++;
+    if (theByte & 0x80)                             // Set DDRAM Address
+    {
+        hd44780.ac = theByte & 0x7F;
+        hd44780.to_cgram = 0;
+        if (ddram_index(hd44780.ac) == 0xFF)
+            violation("DDRAM address 0x%02X does not exist", hd44780.ac);
+    }
+    else if (theByte & 0x40)                        // Set CGRAM Address
+    {
+        hd44780.ac = theByte & 0x3F;
+        hd44780.to_cgram = 1;
+    }
+    else if (theByte & 0x20)                        // Function Set
+    {
+        if (!hd44780.four_bit)
+        {
+            hd44780.resets++;
+            if (hd44780.resets == 1)
+                exec = hd_reset_first;
+            else if (hd44780.resets == 2)
+                exec = hd_reset_second;
+        }
+        hd44780.four_bit = !(theByte & 0x10);
+        hd44780.two_lines = (theByte & 0x08) != 0;
+        hd44780.big_font = (theByte & 0x04) != 0;
+    }
+    else if (theByte & 0x10)                        // Cursor or Display Shift
+    {
+        int8_t step = (theByte & 0x04) ? 1 : -1;
+
+        if (theByte & 0x08)
+            hd44780.offset = (hd44780.offset + 40 - step) % 40;
+        else
+        {
+            uint8_t increment = hd44780.increment;
+
+            hd44780.increment = step > 0;
+            ac_step();
+            hd44780.increment = increment;
+        }
+    }
+    else if (theByte & 0x08)                        // Display On/Off Control
+    {
+        hd44780.display_on = (theByte & 0x04) != 0;
+        hd44780.cursor_on = (theByte & 0x02) != 0;
+        hd44780.blink_on = (theByte & 0x01) != 0;
+    }
+    else if (theByte & 0x04)                        // Entry Mode Set
+    {
+        hd44780.increment = (theByte & 0x02) != 0;
+        hd44780.shift_on_write = (theByte & 0x01) != 0;
+    }
+    else if (theByte & 0x02)                        // Return Home
+    {
+        hd44780.ac = 0;
+        hd44780.to_cgram = 0;
+        hd44780.offset = 0;
+        exec = hd_exec_slow;
+    }
+    else if (theByte & 0x01)                        // Clear Display
+    {
+        memset(hd44780.ddram, ' ', sizeof(hd44780.ddram));
+        hd44780.ac = 0;
+        hd44780.to_cgram = 0;
+        hd44780.offset = 0;
+        hd44780.increment = 1;
+        exec = hd_exec_slow;
+    }
+    hd44780.busy_until = sim_now + exec;
+}
+
+static void data(uint8_t theByte)
+{
+    hd44780.characters++;
+    if (hd44780.to_cgram)
+        hd44780.cgram[hd44780.ac & 0x3F] = theByte & 0x1F;
+    else
+    {
+        uint8_t i = ddram_index(hd44780.ac);
+
+        if (i == 0xFF)
+            violation("data written to DDRAM address 0x%02X, which does not exist", hd44780.ac);
+        else
+            hd44780.ddram[i] = theByte;
+        if (hd44780.shift_on_write)
+            hd44780.offset = (hd44780.offset + (hd44780.increment ? 1 : 39)) % 40;
+    }
+    ac_step();
+    hd44780.busy_until = sim_now + hd_exec;
+}
+
+// one falling edge of E
+static void strobe(void)
+{
+    uint8_t nibble = hd44780.data;
+    uint8_t rs = hd44780.rs;
+
+    hd44780.strobes++;
+    if (!hd44780.four_bit)                          // 8-bit interface - D0..D3 are not wired (read 0)
+    {
+        if (sim_now < hd44780.busy_until)
+            violation("%s 0x%02X sent %.1f uS early", rs ? "character" : "instruction", nibble << 4,
+                      sim_to_us(hd44780.busy_until - sim_now));
+        if (rs)
+            data(nibble << 4);
+        else
+            instruction(nibble << 4);
+        return;
+    }
+    if (!hd44780.has_high)
+    {
+        if (sim_now < hd44780.busy_until)
+            violation("%s sent %.1f uS before the previous one finished", rs ? "character" : "instruction",
+                      sim_to_us(hd44780.busy_until - sim_now));
+        hd44780.high = nibble;
+        hd44780.high_rs = rs;
+        hd44780.has_high = 1;
+        return;
+    }
+    hd44780.has_high = 0;
+    if (rs != hd44780.high_rs)
+        violation("RS changed between the two nibbles of one byte");
+    if (rs)
+        data((hd44780.high << 4) | nibble);
+    else
+        instruction((hd44780.high << 4) | nibble);
+}
+
+// the nibble a read strobe puts on D4..D7: the busy flag and the address counter with RS low,
+//   the RAM byte at the address counter with RS high
+static uint8_t read_nibble(void)
+{
+    uint8_t theByte;
+    uint8_t i;
+
+    if (!hd44780.rs)
+        theByte = (hd44780_busy() ? 0x80 : 0) | (hd44780.ac & 0x7F);
+    else if (hd44780.to_cgram)
+        theByte = hd44780.cgram[hd44780.ac & 0x3F];
+    else
+        theByte = ((i = ddram_index(hd44780.ac)) == 0xFF) ? 0 : hd44780.ddram[i];
+    return (hd44780.four_bit && hd44780.read_low) ? theByte & 0x0F : theByte >> 4;
+}
+
+// the end of a read strobe - a RAM read moves the address counter on, as a write does
+static void read_done(void)
+{
+    hd44780.reads++;
+    if (hd44780.has_high)
+        violation("read between the two nibbles of a write");
+    if (hd44780.four_bit)
+    {
+        hd44780.read_low = !hd44780.read_low;
+        if (hd44780.read_low)                       // the high nibble - the low one follows
+            return;
+    }
+    if (hd44780.rs)
+        ac_step();
+}
+
+static volatile uint8_t *pin_of(volatile uint8_t *thePort)
+{
+    return (thePort == &PORTB) ? &PINB : (thePort == &PORTC) ? &PINC : (thePort == &PORTD) ? &PIND : &PINE;
+}
+
+// D4..D7 as the firmware reads them: driven by the model during a read, else pulled up
+static void drive(uint8_t theNibble)
+{
+    volatile uint8_t *pin = pin_of(d_port);
+
+    *pin = (*pin & ~(0x0F << d4_bit)) | (theNibble << d4_bit);
+}
+
+// a pin is driven only while its DDR bit is set; RS and the data lines have pull-ups in the
+//   controller, E does not (an undriven E is taken as low); the pins of anything other than
+//   an AVR port (a port expander) are always driven
+static uint8_t level(volatile uint8_t *thePort, uint8_t theBits, uint8_t thePullUp)
+{
+    static volatile uint8_t driven = 0xFF;
+    volatile uint8_t *ddr = (thePort == &PORTB) ? &DDRB : (thePort == &PORTC) ? &DDRC :
+                            (thePort == &PORTD) ? &DDRD : (thePort == &PORTE) ? &DDRE : &driven;
+
+    return (*thePort & *ddr & theBits) | (thePullUp ? ~*ddr & theBits : 0);
+}
+
+static void update(void)
+{
+    uint8_t e = level(e_port, 1 << e_bit, 0) != 0;
+    uint8_t rs = level(rs_port, 1 << rs_bit, 1) != 0;
+    uint8_t d = level(d_port, 0x0F << d4_bit, 1) >> d4_bit;
+    uint8_t rw = rw_port ? level(rw_port, 1 << rw_bit, 1) != 0 : 0;
+
+    if (rw != hd44780.rw)
+    {
+        if (hd44780.e && !hd44780.e_held)
+            violation("RW changed while E was high");
+        hd44780.rw = rw;
+        hd44780.rs_change = sim_now;                // same set-up time as RS
+    }
+    if (rs != hd44780.rs)
+    {
+        if (hd44780.e && !hd44780.e_held)
+            violation("RS changed while E was high");
+        else if (sim_now - hd44780.e_fall < hd_tAH)
+            violation("RS changed %.0f nS after E fell", sim_to_us(sim_now - hd44780.e_fall) * 1000);
+        hd44780.rs = rs;
+        hd44780.rs_change = sim_now;
+    }
+    if (d != hd44780.data)
+    {
+        if (!hd44780.e && sim_now - hd44780.e_fall < hd_tH)
+            violation("data changed %.0f nS after E fell", sim_to_us(sim_now - hd44780.e_fall) * 1000);
+        hd44780.data = d;
+        hd44780.data_change = sim_now;
+    }
+    if (e && !hd44780.e)                            // rising edge
+    {
+        if (sim_now - hd44780.rs_change < hd_tAS)
+            violation("RS set up only %.0f nS before E rose", sim_to_us(sim_now - hd44780.rs_change) * 1000);
+        if (hd44780.strobes && sim_now - hd44780.e_rise < hd_tcycE)
+            violation("E cycle of %.0f nS", sim_to_us(sim_now - hd44780.e_rise) * 1000);
+        hd44780.e_rise = sim_now;
+        if (rw)
+            drive(read_nibble());                   // valid after tDDR (160 nS) - not checked
+    }
+    else if (!e && hd44780.e_held)                  // released after power-on
+    {
+        hd44780.e_fall = sim_now;
+        hd44780.e_held = 0;
+    }
+    else if (!e && hd44780.e)                       // falling edge - the controller takes the nibble
+    {
+        if (sim_now - hd44780.e_rise < hd_PWEH)
+            violation("E high for only %.0f nS", sim_to_us(sim_now - hd44780.e_rise) * 1000);
+        if (sim_now - hd44780.data_change < hd_tDSW)
+            violation("data set up only %.0f nS before E fell", sim_to_us(sim_now - hd44780.data_change) * 1000);
+        hd44780.e_fall = sim_now;
+        hd44780.e = 0;
+        if (rw)
+        {
+            drive(0x0F);
+            read_done();
+        }
+        else
+            strobe();
+    }
+    hd44780.e = e;
+}
+
+/*
+  Name:     hd44780_attach
+  Purpose:  power the model up and connect it to the RS, E and D4..D7 pins
+  Entry:    port and bit of RS, port and bit of E, port and lowest bit of D4..D7 (consecutive)
+  Notes:    call after sim_init - power-on is at the current virtual time
+*/
+void hd44780_attach(volatile uint8_t *theRsPort, uint8_t theRsBit, volatile uint8_t *theEPort, uint8_t theEBit,
+                    volatile uint8_t *theDataPort, uint8_t theD4Bit)
+{
+    memset(&hd44780, 0, sizeof(hd44780));
+    memset(hd44780.ddram, ' ', sizeof(hd44780.ddram));
+    hd44780.increment = 1;
+    hd44780.busy_until = sim_now + hd_power_on;
+    rs_port = theRsPort;
+    rs_bit = theRsBit;
+    e_port = theEPort;
+    e_bit = theEBit;
+    d_port = theDataPort;
+    d4_bit = theD4Bit;
+    hd44780.e = level(e_port, 1 << e_bit, 0) != 0;
+    hd44780.e_held = hd44780.e;
+    hd44780.rs = level(rs_port, 1 << rs_bit, 1) != 0;
+    hd44780.data = level(d_port, 0x0F << d4_bit, 1) >> d4_bit;
+    rw_port = NULL;
+    drive(0x0F);
+    sim_port_hook = update;
+}
+
+/*
+  Name:     hd44780_attach_rw
+  Purpose:  connect the RW pin, so the firmware can read the busy flag
+  Entry:    port and bit of RW
+  Notes:    call after hd44780_attach; RW is pulled up in the controller
+*/
+void hd44780_attach_rw(volatile uint8_t *thePort, uint8_t theBit)
+{
+    rw_port = thePort;
+    rw_bit = theBit;
+    hd44780.rw = level(rw_port, 1 << rw_bit, 1) != 0;
+}
+
+/*
+  Name:     hd44780_cell
+  Purpose:  character code shown at one position of the 2 x 16 display
+  Entry:    (theLine) 0 or 1, (theColumn) 0 - 15
+  Exit:     the DDRAM byte at that position, after the display shift
+*/
+uint8_t hd44780_cell(uint8_t theLine, uint8_t theColumn)
+{
+    return hd44780.ddram[theLine * 40 + (theColumn + hd44780.offset) % 40];
+}
+
+int hd44780_busy(void)
+{
+    return hd44780.stuck_busy || sim_now < hd44780.busy_until;
+}
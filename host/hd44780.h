@@ -0,0 +1,55 @@
+/*
+  HD44780 model for the host build
+
+  Watches the RS, E and D4..D7 port pins (through sim_port_hook), latches a nibble on every
+  falling edge of E and executes instructions and data writes the way the controller does:
+  8-bit interface after power-on until a Function Set selects 4 bits, DDRAM of 80 bytes in
+  two lines of 40 (0x00 - 0x27, 0x40 - 0x67), 64 bytes of CGRAM, entry mode, display
+  shift.  Every bus timing the datasheet gives for a write is checked against virtual time:
+  the power-on and reset waits, the execution time of the previous instruction, E pulse
+  width and cycle time, address and data set-up and hold.  A violation is counted and the
+  first one is kept as text.  An E that is already high at power-on (a port expander comes
+  up with every pin high) is not a strobe: its first fall only releases it.
+
+  With RW attached (hd44780_attach_rw) a strobe with RW high is a read: the model drives
+  D4..D7 on the PIN register while E is high, with the busy flag and the address counter, or
+  the RAM byte at the address counter, high nibble first.  Without it RW is taken as tied
+  to ground, as on most boards.
+*/
+#ifndef HOST_HD44780_H
+#define HOST_HD44780_H
+
+#include <stdint.h>
+#include "sim.h"
+
+struct hd44780 {
+    uint8_t ddram[80];                              // line one at 0..39, line two at 40..79
+    uint8_t cgram[64];
+    uint8_t ac;                                     // address counter
+    uint8_t to_cgram;                               // ac addresses CGRAM
+    uint8_t increment, shift_on_write;              // entry mode
+    uint8_t display_on, cursor_on, blink_on;
+    uint8_t four_bit, two_lines, big_font;
+    uint8_t offset;                                 // display shift, 0 - 39
+    uint8_t resets;                                 // Function Sets seen in 8-bit mode
+    uint8_t high, high_rs, has_high;                // first nibble of a 4-bit pair
+    uint8_t read_low;                               // the next read gives the low nibble
+    sim_time_t busy_until;
+    uint8_t stuck_busy;                             // test hook: the busy flag never clears
+    // bus
+    uint8_t e, rs, rw, data;                        // pin levels last seen
+    uint8_t e_held;                                 // E high since power-on, not yet a strobe
+    sim_time_t e_rise, e_fall, rs_change, data_change;
+    // statistics
+    uint32_t strobes, instructions, characters, reads, violations;
+    char first_violation[160];
+};
+
+extern struct hd44780 hd44780;
+
+void hd44780_attach(volatile uint8_t *, uint8_t, volatile uint8_t *, uint8_t, volatile uint8_t *, uint8_t);
+void hd44780_attach_rw(volatile uint8_t *, uint8_t);
+uint8_t hd44780_cell(uint8_t, uint8_t);
+int hd44780_busy(void);
+
+#endif
@@ -0,0 +1,10 @@
+/*
+  Host stand-in for <avr/cpufunc.h>
+*/
+#ifndef HOST_AVR_CPUFUNC_H
+#define HOST_AVR_CPUFUNC_H
+
+#define _NOP()              __asm__ __volatile__ ("" ::: "memory")
+#define _MemoryBarrier()    __asm__ __volatile__ ("" ::: "memory")
+
+#endif
@@ -0,0 +1,26 @@
+/*
+  Host stand-in for <avr/eeprom.h>
+
+  EEMEM variables are placed in the host_eeprom section, which is the simulated EEPROM:
+  host/sim.c erases it at start-up and the EECR strobes read and write it byte by byte
+  through the address left in EEAR.  The block functions below are for the firmware's
+  synchronous accesses.
+*/
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+#define EEMEM               __attribute__((section("host_eeprom")))
+
+#define eeprom_is_ready()   (!(EECR & (1<<EEPE)))
+#define eeprom_read_byte(a) (*(const uint8_t *)(a))
+#define eeprom_read_block(dst, src, n)      ((void)memcpy((dst), (src), (n)))
+#define eeprom_update_block(src, dst, n)    ((void)memcpy((dst), (src), (n)))
+#define eeprom_write_block(src, dst, n)     ((void)memcpy((dst), (src), (n)))
+#define eeprom_update_byte(a, v)            ((void)(*(uint8_t *)(a) = (v)))
+#define eeprom_write_byte(a, v)             ((void)(*(uint8_t *)(a) = (v)))
+
+#endif
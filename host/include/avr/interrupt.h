@@ -0,0 +1,25 @@
+/*
+  Host stand-in for <avr/interrupt.h>
+
+  An interrupt handler is an ordinary function named after its vector; host/sim.c calls it
+  when the flag and enable bits say so and the I bit of SREG is set.  As on the AVR, sei()
+  takes effect after the next instruction, so sei(); sleep_cpu(); still cannot miss the
+  interrupt that should end the sleep - the simulator dispatches pending interrupts only when
+  the firmware next touches simulated hardware.
+*/
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector, ...)    void vector(void); void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void); void vector(void) {}
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define reti()              return
+
+#define sei()               (SREG |= 0x80)
+#define cli()               (SREG &= ~0x80)
+
+#endif
@@ -0,0 +1,269 @@
+/*
+  Host stand-in for <avr/io.h> (ATmega328PB subset used by the firmware)
+
+  The I/O registers are plain variables owned by host/sim.c, which moves the timers, the
+  USART, the EEPROM and the pin-change logic forward in virtual time.  A few registers
+  need more than a variable:
+    - the interrupt flag registers are cleared by writing a one; they are reached through
+      sim_flag_register(), which applies the previous write before every access
+    - UDR0 is 16 bits wide so the simulator can see whether USART0_UDRE wrote it, and TWCR0
+      so it can see every write (TWINT is cleared by writing a one, which starts the next
+      bus action)
+    - EEAR is pointer sized because EEMEM variables live in a host section (see eeprom.h)
+*/
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+#define host_reg8(name)     extern volatile uint8_t name;
+#define host_reg16(name)    extern volatile uint16_t name;
+
+host_reg8(PINB)  host_reg8(DDRB)  host_reg8(PORTB)
+host_reg8(PINC)  host_reg8(DDRC)  host_reg8(PORTC)
+host_reg8(PIND)  host_reg8(DDRD)  host_reg8(PORTD)
+host_reg8(PINE)  host_reg8(DDRE)  host_reg8(PORTE)
+
+host_reg8(PCICR) host_reg8(PCMSK0) host_reg8(PCMSK1) host_reg8(PCMSK2)
+
+host_reg8(TCCR0A) host_reg8(TCCR0B) host_reg8(TCNT0) host_reg8(OCR0A) host_reg8(OCR0B) host_reg8(TIMSK0)
+host_reg8(TCCR1A) host_reg8(TCCR1B) host_reg8(TCCR1C) host_reg16(TCNT1) host_reg16(OCR1A) host_reg16(OCR1B) host_reg16(ICR1) host_reg8(TIMSK1)
+host_reg8(TCCR2A) host_reg8(TCCR2B) host_reg8(TCNT2) host_reg8(OCR2A) host_reg8(OCR2B) host_reg8(TIMSK2) host_reg8(ASSR)
+host_reg8(TCCR3A) host_reg8(TCCR3B) host_reg8(TCCR3C) host_reg16(TCNT3) host_reg16(OCR3A) host_reg16(OCR3B) host_reg16(ICR3) host_reg8(TIMSK3)
+host_reg8(TCCR4A) host_reg8(TCCR4B) host_reg8(TCCR4C) host_reg16(TCNT4) host_reg16(OCR4A) host_reg16(OCR4B) host_reg16(ICR4) host_reg8(TIMSK4)
+host_reg8(GTCCR)
+
+host_reg8(SMCR) host_reg8(MCUCR) host_reg8(MCUSR) host_reg8(WDTCSR) host_reg8(PRR0) host_reg8(PRR1)
+host_reg8(SREG) host_reg8(GPIOR0) host_reg8(GPIOR1) host_reg8(GPIOR2)
+
+host_reg8(EECR) host_reg8(EEDR)
+extern volatile uintptr_t EEAR;
+
+host_reg8(UCSR0A) host_reg8(UCSR0B) host_reg8(UCSR0C) host_reg16(UBRR0) host_reg16(UDR0)
+
+host_reg8(TWBR0) host_reg8(TWSR0) host_reg8(TWAR0) host_reg8(TWDR0) host_reg16(TWCR0)
+
+host_reg16(SP)
+
+// write-one-to-clear flag registers
+#define sim_TIFR0           0
+#define sim_TIFR1           1
+#define sim_TIFR2           2
+#define sim_TIFR3           3
+#define sim_TIFR4           4
+#define sim_PCIFR           5
+#define sim_flag_registers  6
+volatile uint16_t *sim_flag_register(uint8_t);
+#define TIFR0               (*sim_flag_register(sim_TIFR0))
+#define TIFR1               (*sim_flag_register(sim_TIFR1))
+#define TIFR2               (*sim_flag_register(sim_TIFR2))
+#define TIFR3               (*sim_flag_register(sim_TIFR3))
+#define TIFR4               (*sim_flag_register(sim_TIFR4))
+#define PCIFR               (*sim_flag_register(sim_PCIFR))
+
+#define RAMSTART            0x0100
+#define RAMEND              0x08FF
+#define E2END               0x03FF
+
+// port bits
+#define PORTB0 0
+#define PORTB1 1
+#define PORTB2 2
+#define PORTB3 3
+#define PORTB4 4
+#define PORTB5 5
+#define PORTB6 6
+#define PORTB7 7
+#define PORTC0 0
+#define PORTC1 1
+#define PORTC2 2
+#define PORTC3 3
+#define PORTC4 4
+#define PORTC5 5
+#define PORTC6 6
+#define PORTD0 0
+#define PORTD1 1
+#define PORTD2 2
+#define PORTD3 3
+#define PORTD4 4
+#define PORTD5 5
+#define PORTD6 6
+#define PORTD7 7
+#define PORTE0 0
+#define PORTE1 1
+#define PORTE2 2
+#define PORTE3 3
+#define PINC0 0
+#define PINC1 1
+#define PINC2 2
+#define PINC3 3
+#define PIND0 0
+
+// pin change interrupts
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCIE3 3
+#define PCIF0 0
+#define PCIF1 1
+#define PCIF2 2
+#define PCIF3 3
+#define PCINT8 0
+#define PCINT9 1
+#define PCINT10 2
+#define PCINT11 3
+#define PCINT16 0
+
+// Timer/Counter0
+#define COM0A1 7
+#define COM0A0 6
+#define COM0B1 5
+#define COM0B0 4
+#define WGM01 1
+#define WGM00 0
+#define WGM02 3
+#define CS02 2
+#define CS01 1
+#define CS00 0
+#define OCIE0B 2
+#define OCIE0A 1
+#define TOIE0 0
+#define OCF0B 2
+#define OCF0A 1
+#define TOV0 0
+
+// Timer/Counter1, 3 and 4 (same layout)
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+#define ICNC1 7
+#define ICES1 6
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define ICIE1 5
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1 0
+#define ICF1 5
+#define OCF1B 2
+#define OCF1A 1
+#define TOV1 0
+#define WGM31 1
+#define WGM30 0
+#define WGM33 4
+#define WGM32 3
+#define CS32 2
+#define CS31 1
+#define CS30 0
+#define OCIE3B 2
+#define OCIE3A 1
+#define TOIE3 0
+#define OCF3B 2
+#define OCF3A 1
+#define TOV3 0
+#define COM4A1 7
+#define COM4A0 6
+#define COM4B1 5
+#define COM4B0 4
+#define WGM41 1
+#define WGM40 0
+#define WGM43 4
+#define WGM42 3
+#define CS42 2
+#define CS41 1
+#define CS40 0
+#define OCIE4B 2
+#define OCIE4A 1
+#define TOIE4 0
+#define OCF4B 2
+#define OCF4A 1
+#define TOV4 0
+
+// Timer/Counter2 (asynchronous)
+#define COM2A1 7
+#define COM2A0 6
+#define COM2B1 5
+#define COM2B0 4
+#define WGM21 1
+#define WGM20 0
+#define WGM22 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+#define OCIE2B 2
+#define OCIE2A 1
+#define TOIE2 0
+#define OCF2B 2
+#define OCF2A 1
+#define TOV2 0
+#define EXCLK 6
+#define AS2 5
+#define TCN2UB 4
+#define OCR2AUB 3
+#define OCR2BUB 2
+#define TCR2AUB 1
+#define TCR2BUB 0
+#define TSM 7
+#define PSRASY 1
+#define PSRSYNC 0
+
+// sleep, reset and watchdog
+#define SM2 3
+#define SM1 2
+#define SM0 1
+#define SE 0
+#define WDRF 3
+#define BORF 2
+#define EXTRF 1
+#define PORF 0
+#define WDIF 7
+#define WDIE 6
+#define WDP3 5
+#define WDCE 4
+#define WDE 3
+#define WDP2 2
+#define WDP1 1
+#define WDP0 0
+
+// EEPROM
+#define EEPM1 5
+#define EEPM0 4
+#define EERIE 3
+#define EEMPE 2
+#define EEPE 1
+#define EERE 0
+
+// USART0
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define MPCM0 0
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ02 2
+#define UCSZ01 2
+#define UCSZ00 1
+
+// TWI0
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+
+#endif
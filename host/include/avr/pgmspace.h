@@ -0,0 +1,21 @@
+/*
+  Host stand-in for <avr/pgmspace.h> - flash and RAM share one address space on the host
+*/
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P               const char *
+#define PSTR(s)             (s)
+#define pgm_read_byte(a)    (*(const uint8_t *)(a))
+#define pgm_read_word(a)    (*(const uint16_t *)(a))
+#define pgm_read_dword(a)   (*(const uint32_t *)(a))
+#define pgm_read_ptr(a)     (*(void * const *)(a))
+#define memcpy_P            memcpy
+#define strlen_P            strlen
+#define strcmp_P            strcmp
+
+#endif
@@ -0,0 +1,26 @@
+/*
+  Host stand-in for <avr/sleep.h> - sleep_cpu() hands the CPU to host/sim.c, which advances
+  virtual time to the next event the selected mode lets through and runs its handler
+*/
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_ADC          ((1<<SM0))
+#define SLEEP_MODE_PWR_DOWN     ((1<<SM1))
+#define SLEEP_MODE_PWR_SAVE     ((1<<SM1)|(1<<SM0))
+#define SLEEP_MODE_STANDBY      ((1<<SM2)|(1<<SM1))
+#define SLEEP_MODE_EXT_STANDBY  ((1<<SM2)|(1<<SM1)|(1<<SM0))
+
+void sim_sleep_cpu(void);
+
+#define set_sleep_mode(mode)    (SMCR = (SMCR & ~((1<<SM2)|(1<<SM1)|(1<<SM0))) | (mode))
+#define sleep_enable()          (SMCR |= (1<<SE))
+#define sleep_disable()         (SMCR &= ~(1<<SE))
+#define sleep_cpu()             sim_sleep_cpu()
+#define sleep_mode()            do { sleep_enable(); sleep_cpu(); sleep_disable(); } while (0)
+#define sleep_bod_disable()
+
+#endif
@@ -0,0 +1,26 @@
+/*
+  Host stand-in for <avr/wdt.h>
+*/
+#ifndef HOST_AVR_WDT_H
+#define HOST_AVR_WDT_H
+
+#include <avr/io.h>
+
+#define WDTO_15MS   0
+#define WDTO_30MS   1
+#define WDTO_60MS   2
+#define WDTO_120MS  3
+#define WDTO_250MS  4
+#define WDTO_500MS  5
+#define WDTO_1S     6
+#define WDTO_2S     7
+#define WDTO_4S     8
+#define WDTO_8S     9
+
+void sim_wdt_reset(void);
+
+#define wdt_reset()         sim_wdt_reset()
+#define wdt_enable(value)   (WDTCSR = (1<<WDE) | ((value) & 0x08 ? (1<<WDP3) : 0) | ((value) & 0x07))
+#define wdt_disable()       (WDTCSR = 0)
+
+#endif
@@ -0,0 +1,35 @@
+/*
+  Host stand-in for <util/atomic.h> - the same cleanup-attribute construction as avr-libc,
+  so a return or break inside the block still restores SREG
+*/
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+static inline uint8_t sim_irq_save(void)
+{
+    uint8_t sreg = SREG;
+
+    SREG = sreg & ~0x80;
+    return sreg;
+}
+
+static inline void sim_irq_restore(const uint8_t *sreg)
+{
+    SREG = *sreg;
+}
+
+static inline void sim_irq_on(const uint8_t *sreg)
+{
+    (void)sreg;
+    SREG |= 0x80;
+}
+
+#define ATOMIC_RESTORESTATE sim_irq_restore
+#define ATOMIC_FORCEON      sim_irq_on
+#define ATOMIC_BLOCK(type)  for (uint8_t sim_sreg __attribute__((__cleanup__(type))) = sim_irq_save(), \
+                                 sim_once = 1; sim_once; sim_once = 0)
+
+#endif
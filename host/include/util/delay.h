@@ -0,0 +1,12 @@
+/*
+  Host stand-in for <util/delay.h> - a busy-wait is charged to virtual time
+*/
+#ifndef HOST_UTIL_DELAY_H
+#define HOST_UTIL_DELAY_H
+
+void sim_delay_us(double);
+
+#define _delay_us(t)        sim_delay_us(t)
+#define _delay_ms(t)        sim_delay_us((t) * 1000.0)
+
+#endif
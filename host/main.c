@@ -0,0 +1,235 @@
+/*
+  The firmware as a Linux program, on the simulated board
+
+  usage: timer [-s seconds] [-p] [event ...]
+
+  Runs the firmware for the given virtual time (10 s by default) as fast as the host allows
+  and prints the display each time it changes, and every line the firmware sends on the
+  serial port.  Events are applied at a virtual time in milliseconds:
+    <ms>:S<n>[+<hold>]    press button S1..S4, for <hold> mS (default 100)
+    <ms>:<text>           type <text> and Enter on the serial line
+  e.g. timer -s 40 500:S2 1000:S1 "2000:C 015"
+
+  With -p the serial port is a pseudo-terminal instead, whose name is printed at start-up,
+  and virtual time is paced to run no faster than real time, so a terminal program or
+  tools/timer_cmd.py can talk to the firmware as to the board (until Ctrl-C, or -s).
+*/
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "firmware.h"
+
+#define event_max           64
+
+struct event {
+    sim_time_t at;
+    uint8_t buttons;                                // to press, or 0 for text
+    sim_time_t hold;
+    const char *text;
+};
+
+static struct event events[event_max];
+static int event_count;
+static char shown[2][lcd_Columns * 3 + 1];
+static int pty = -1;                                // master side with -p
+
+// one display cell as UTF-8 - a custom character as the half (or both) its pixels cover
+static const char *render_cell(uint8_t theCode)
+{
+    uint8_t upper = 0, lower = 0, row;
+
+    if (theCode == 0xFF)
+        return "█";
+    if (theCode >= 0x20 && theCode < 0x7F)
+    {
+        static char text[2];
+
+        text[0] = theCode;
+        return text;
+    }
+    if (theCode >= 0x10)
+        return "?";
+    for (row = 0; row < 8; row++)
+        *(row < 4 ? &upper : &lower) |= hd44780.cgram[(theCode & 0x07) * 8 + row];
+    if (upper && lower)
+        return "█";
+    return upper ? "▀" : lower ? "▄" : " ";
+}
+
+static void show_display(void)
+{
+    char line[2][lcd_Columns * 3 + 1];
+    uint8_t l, c;
+
+    for (l = 0; l < 2; l++)
+    {
+        line[l][0] = 0;
+        for (c = 0; c < lcd_Columns; c++)
+            strcat(line[l], hd44780.display_on ? render_cell(hd44780_cell(l, c)) : " ");
+    }
+    if (!strcmp(line[0], shown[0]) && !strcmp(line[1], shown[1]))
+        return;
+    memcpy(shown, line, sizeof(shown));
+    printf("%10.3f |%s|\n           |%s|\n", sim_seconds(), line[0], line[1]);
+}
+
+static void show_uart(void)
+{
+    char *end;
+
+    while ((end = memchr(sim_uart_out, '\n', sim_uart_out_len)) != NULL)
+    {
+        size_t n = end - sim_uart_out + 1;
+
+        printf("%10.3f uart> %.*s\n", sim_seconds(), (int)(n - 1), sim_uart_out);
+        memmove(sim_uart_out, sim_uart_out + n, sim_uart_out_len - n + 1);
+        sim_uart_out_len -= n;
+    }
+}
+
+// each byte the firmware sends - to the pseudo-terminal, and kept for show_uart
+static void pty_send(uint8_t theByte)
+{
+    if (write(pty, &theByte, 1) != 1 && errno != EAGAIN)
+        perror("pty");
+    if (sim_uart_out_len < 65535)
+    {
+        sim_uart_out[sim_uart_out_len++] = theByte;
+        sim_uart_out[sim_uart_out_len] = 0;
+    }
+}
+
+static int pty_open(void)
+{
+    struct termios raw;
+    const char *name;
+
+    if ((pty = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(pty) || unlockpt(pty) || !(name = ptsname(pty)))
+        return 0;
+    if (open(name, O_RDWR | O_NOCTTY) < 0)          // held open, so the master never reads EIO between clients
+        return 0;
+    tcgetattr(pty, &raw);
+    cfmakeraw(&raw);
+    tcsetattr(pty, TCSANOW, &raw);
+    fcntl(pty, F_SETFL, O_NONBLOCK);
+    sim_uart_sink = pty_send;
+    printf("serial port: %s\n", name);
+    return 1;
+}
+
+// bytes typed on the pseudo-terminal go to the USART
+static void pty_receive(void)
+{
+    char buffer[64];
+    ssize_t n;
+
+    while ((n = read(pty, buffer, sizeof(buffer))) > 0)
+        sim_uart_rx(buffer, n);
+}
+
+// hold virtual time back to the wall clock
+static void pace(const struct timespec *theStart)
+{
+    struct timespec now, wait;
+    double ahead;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ahead = sim_seconds() - (now.tv_sec - theStart->tv_sec) - (now.tv_nsec - theStart->tv_nsec) / 1e9;
+    if (ahead > 0)
+    {
+        wait.tv_sec = (time_t)ahead;
+        wait.tv_nsec = (long)((ahead - wait.tv_sec) * 1e9);
+        nanosleep(&wait, NULL);
+    }
+}
+
+static int parse_event(const char *theArg)
+{
+    struct event *e = &events[event_count];
+    char *rest;
+
+    if (event_count == event_max)
+        return 0;
+    e->at = sim_ms(strtoul(theArg, &rest, 10));
+    if (rest == theArg || *rest != ':')
+        return 0;
+    rest++;
+    if (toupper((unsigned char)rest[0]) == 'S' && rest[1] >= '1' && rest[1] <= '4' && (!rest[2] || rest[2] == '+'))
+    {
+        e->buttons = 1 << (rest[1] - '1');
+        e->hold = sim_ms(rest[2] ? strtoul(rest + 3, NULL, 10) : 100);
+    }
+    else
+        e->text = rest;
+    event_count++;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    sim_time_t end = 0;
+    sim_time_t release = sim_never;
+    struct timespec start;
+    int i, next = 0;
+    int use_pty = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            end = sim_s(strtoul(argv[++i], NULL, 10));
+        else if (!strcmp(argv[i], "-p"))
+            use_pty = 1;
+        else if (!parse_event(argv[i]))
+        {
+            fprintf(stderr, "usage: %s [-s seconds] [-p] [<ms>:S<n>[+<hold ms>] | <ms>:<text>] ...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!end)
+        end = use_pty ? sim_never : sim_s(10);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    firmware_boot();
+    if (use_pty && !pty_open())
+    {
+        perror("pseudo-terminal");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (sim_now < end)
+    {
+        if (use_pty)
+        {
+            pty_receive();
+            pace(&start);
+        }
+        for (; next < event_count && events[next].at <= sim_now; next++)
+        {
+            if (events[next].buttons)
+            {
+                sim_buttons(events[next].buttons);
+                release = sim_now + events[next].hold;
+            }
+            else
+            {
+                sim_uart_rx(events[next].text, strlen(events[next].text));
+                sim_uart_rx("\r", 1);
+            }
+        }
+        if (sim_now >= release)
+        {
+            sim_buttons(0);
+            release = sim_never;
+        }
+        sim_run(sim_ms(1));
+        show_display();
+        show_uart();
+    }
+    if (hd44780.violations)
+        printf("LCD timing violations: %u, first at %s\n", (unsigned)hd44780.violations, hd44780.first_violation);
+    return hd44780.violations ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+/*
+  PCF8574 model for the host build - see pcf8574.h
+*/
+#include <string.h>
+#include "pcf8574.h"
+
+struct pcf8574 pcf8574;
+
+static int receive(uint8_t theByte, int theAddress)
+{
+    if (theAddress)
+    {
+        pcf8574.selected = (theByte >> 1) == pcf8574.address && !(theByte & 0x01);
+        if (!pcf8574.selected)
+            pcf8574.nacks++;
+        return pcf8574.selected;
+    }
+    if (!pcf8574.selected)
+        return 0;
+    pcf8574.bytes++;
+    pcf8574.port = theByte;
+    if (sim_port_hook)
+        sim_port_hook();
+    return 1;
+}
+
+/*
+  Name:     pcf8574_attach
+  Purpose:  power the expander up and put it on the TWI bus
+  Entry:    (theAddress) its 7-bit address
+  Notes:    call after sim_init
+*/
+void pcf8574_attach(uint8_t theAddress)
+{
+    memset(&pcf8574, 0, sizeof(pcf8574));
+    pcf8574.port = 0xFF;
+    pcf8574.address = theAddress;
+    sim_twi_slave = receive;
+}
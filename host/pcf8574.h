@@ -0,0 +1,26 @@
+/*
+  PCF8574 model for the host build
+
+  An I2C port expander behind sim_twi_slave: it acknowledges SLA+W with its address and
+  puts every data byte on P0..P7, then calls sim_port_hook, so a model watching the port
+  (the HD44780 of an LCD backpack) sees the pins change at the ACK of each byte.  Reading
+  (SLA+R) is not modelled.
+*/
+#ifndef HOST_PCF8574_H
+#define HOST_PCF8574_H
+
+#include <stdint.h>
+#include "sim.h"
+
+struct pcf8574 {
+    uint8_t port;                                   // P0..P7, high after power-on
+    uint8_t address;                                // 7-bit
+    uint8_t selected;                               // addressed since the last start
+    uint32_t bytes, nacks;
+};
+
+extern struct pcf8574 pcf8574;
+
+void pcf8574_attach(uint8_t);
+
+#endif
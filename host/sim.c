@@ -0,0 +1,1077 @@
+/*
+  Discrete-event model of the ATmega328PB peripherals used by the firmware - see sim.h
+
+  Modelled:  Timer0..4 (normal, CTC and fast PWM; compare A/B and overflow flags), the
+             asynchronous Timer2 clock from the 32.768 kHz crystal, the watchdog interrupt,
+             USART0 frames at the programmed baud rate (RXD also drives PCINT16), pin changes
+             on PINC (PCINT1), the EEPROM with its 3.4 mS write time, the TWI as a master
+             transmitter (start, address and data bytes of 9 SCL periods, stop) with one slave
+             behind sim_twi_slave, the sleep modes (which clocks stop, oscillator start-up on
+             wake-up) and interrupt dispatch in vector order.
+  Not modelled: TWI reception, arbitration and clock stretching, instruction timing other
+             than port writes and delays, resets.
+*/
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <avr/io.h>
+#include "sim.h"
+
+/*============================== Registers ================================*/
+volatile uint8_t PINB, DDRB, PORTB, PINC, DDRC, PORTC, PIND, DDRD, PORTD, PINE, DDRE, PORTE;
+volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, ASSR;
+volatile uint8_t TCCR3A, TCCR3B, TCCR3C, TIMSK3;
+volatile uint16_t TCNT3, OCR3A, OCR3B, ICR3;
+volatile uint8_t TCCR4A, TCCR4B, TCCR4C, TIMSK4;
+volatile uint16_t TCNT4, OCR4A, OCR4B, ICR4;
+volatile uint8_t GTCCR;
+volatile uint8_t SMCR, MCUCR, MCUSR, WDTCSR, PRR0, PRR1, SREG, GPIOR0, GPIOR1, GPIOR2;
+volatile uint8_t EECR, EEDR;
+volatile uintptr_t EEAR;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C;
+volatile uint16_t UBRR0, UDR0;
+volatile uint8_t TWBR0, TWSR0, TWAR0, TWDR0;
+volatile uint16_t TWCR0;
+volatile uint16_t SP;
+
+#define udr_Empty           0x100                   // UDR0 value while nobody has written it
+#define twcr_Seen           0x100                   // in TWCR0 until the firmware writes it
+#define sreg_I              0x80
+#define flag_Latch          0x8000                  // set while the latch holds no firmware write
+
+sim_time_t sim_now;
+struct sim_stats sim_stats;
+uint32_t sim_f_cpu;
+uint32_t sim_startup_cycles;
+int32_t sim_wdt_ppm;
+void (*sim_uart_sink)(uint8_t);
+void (*sim_port_hook)(void);
+int (*sim_twi_slave)(uint8_t, int);
+char sim_uart_out[65536];
+size_t sim_uart_out_len;
+
+extern uint8_t __start_host_eeprom[] __attribute__((weak));
+extern uint8_t __stop_host_eeprom[] __attribute__((weak));
+
+static uint8_t sleeping;                            // in sleep_cpu, clocks of sleep_mode stopped
+static uint8_t sleep_mode;
+static uint8_t waking;                              // woken, the oscillator is starting
+
+/*============================== Flag Registers ===========================*/
+/*
+  The firmware clears a flag by writing a one to it, which a plain variable cannot tell
+  from setting it.  Each flag register is therefore a latch: the simulator leaves the true
+  flags in it with flag_Latch set, a firmware write replaces the whole value (and clears
+  flag_Latch), and the next access applies that write to the true flags.
+*/
+static volatile uint16_t flag_latch[sim_flag_registers];
+static uint8_t flag_bits[sim_flag_registers];
+
+static void flags_sync(uint8_t theReg)
+{
+    uint16_t latch = flag_latch[theReg];
+
+    if (!(latch & flag_Latch))
+        flag_bits[theReg] &= ~latch;
+    flag_latch[theReg] = flag_bits[theReg] | flag_Latch;
+}
+
+volatile uint16_t *sim_flag_register(uint8_t theReg)
+{
+    flags_sync(theReg);
+    return &flag_latch[theReg];
+}
+
+static uint8_t flags_get(uint8_t theReg)
+{
+    flags_sync(theReg);
+    return flag_bits[theReg];
+}
+
+static void flags_set(uint8_t theReg, uint8_t theBits)
+{
+    flags_sync(theReg);
+    flag_bits[theReg] |= theBits;
+    flag_latch[theReg] = flag_bits[theReg] | flag_Latch;
+}
+
+static void flags_clear(uint8_t theReg, uint8_t theBits)
+{
+    flags_sync(theReg);
+    flag_bits[theReg] &= ~theBits;
+    flag_latch[theReg] = flag_bits[theReg] | flag_Latch;
+}
+
+/*============================== Timers ===================================*/
+struct timer {
+    volatile uint8_t *tccra, *tccrb, *timsk;
+    volatile uint8_t *tcnt8, *ocra8, *ocrb8;        // 8-bit timers
+    volatile uint16_t *tcnt16, *ocra16, *ocrb16, *icr16;
+    uint8_t flags;                                  // sim_TIFRn
+    uint8_t async;                                  // Timer2 - may run from the watch crystal
+    uint8_t cs;                                     // clock select at the last step
+    sim_time_t phase;                               // time since the last timer clock
+};
+
+static struct timer timers[] = {
+    { &TCCR0A, &TCCR0B, &TIMSK0, &TCNT0, &OCR0A, &OCR0B, NULL, NULL, NULL, NULL, sim_TIFR0, 0, 0, 0 },
+    { &TCCR1A, &TCCR1B, &TIMSK1, NULL, NULL, NULL, &TCNT1, &OCR1A, &OCR1B, &ICR1, sim_TIFR1, 0, 0, 0 },
+    { &TCCR2A, &TCCR2B, &TIMSK2, &TCNT2, &OCR2A, &OCR2B, NULL, NULL, NULL, NULL, sim_TIFR2, 1, 0, 0 },
+    { &TCCR3A, &TCCR3B, &TIMSK3, NULL, NULL, NULL, &TCNT3, &OCR3A, &OCR3B, &ICR3, sim_TIFR3, 0, 0, 0 },
+    { &TCCR4A, &TCCR4B, &TIMSK4, NULL, NULL, NULL, &TCNT4, &OCR4A, &OCR4B, &ICR4, sim_TIFR4, 0, 0, 0 },
+};
+#define timer_count_of(t)   (sizeof(timers) / sizeof(timers[0]))
+
+static uint32_t timer_cnt(const struct timer *t)
+{
+    return t->tcnt8 ? *t->tcnt8 : *t->tcnt16;
+}
+
+static void timer_set_cnt(const struct timer *t, uint32_t theCount)
+{
+    if (t->tcnt8)
+        *t->tcnt8 = theCount;
+    else
+        *t->tcnt16 = theCount;
+}
+
+static uint32_t timer_ocra(const struct timer *t)
+{
+    return t->tcnt8 ? *t->ocra8 : *t->ocra16;
+}
+
+static uint32_t timer_ocrb(const struct timer *t)
+{
+    return t->tcnt8 ? *t->ocrb8 : *t->ocrb16;
+}
+
+static uint32_t timer_max(const struct timer *t)
+{
+    return t->tcnt8 ? 0xFF : 0xFFFF;
+}
+
+static uint8_t timer_wgm(const struct timer *t)
+{
+    if (t->tcnt8)
+        return (*t->tccra & 0x03) | (((*t->tccrb >> WGM02) & 0x01) << 2);
+    return (*t->tccra & 0x03) | (((*t->tccrb >> WGM12) & 0x03) << 2);
+}
+
+static int timer_ctc(const struct timer *t)
+{
+    uint8_t wgm = timer_wgm(t);
+
+    return t->tcnt8 ? (wgm == 2) : (wgm == 4 || wgm == 12);
+}
+
+static uint32_t timer_top(const struct timer *t)
+{
+    uint8_t wgm = timer_wgm(t);
+
+    if (t->tcnt8)
+        return (wgm == 2 || wgm == 5 || wgm == 7) ? timer_ocra(t) : 0xFF;
+    switch (wgm)
+    {
+    case 1: case 5:                     return 0xFF;
+    case 2: case 6:                     return 0x1FF;
+    case 3: case 7:                     return 0x3FF;
+    case 4: case 9: case 11: case 15:   return timer_ocra(t);
+    case 8: case 10: case 12: case 14:  return *t->icr16;
+    default:                            return 0xFFFF;
+    }
+}
+
+static int clk_io_stopped(void)
+{
+    return sleeping && sleep_mode != sim_Idle && sleep_mode != 1;     // all but idle and ADC noise reduction
+}
+
+// virtual time per timer clock, 0 while the timer cannot count
+static sim_time_t timer_period(const struct timer *t)
+{
+    static const uint16_t sync_div[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };   // 6, 7: external pin
+    static const uint16_t async_div[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+    uint8_t cs = *t->tccrb & 0x07;
+
+    if (t->async)
+    {
+        if (ASSR & (1<<AS2))                        // watch crystal - stops only in power-down and standby
+        {
+            if (sleeping && (sleep_mode == sim_PowerDown || sleep_mode == 6))
+                return 0;
+            return async_div[cs] * (sim_Hz / 32768);
+        }
+        if (clk_io_stopped())
+            return 0;
+        return async_div[cs] * (sim_Hz / sim_f_cpu);
+    }
+    if (clk_io_stopped())
+        return 0;
+    return sync_div[cs] * (sim_Hz / sim_f_cpu);
+}
+
+// timer clocks until the compare flag for theValue is next set, 0 if it never is - as on the
+//   AVR, the flag is set on the clock that moves the counter on from theValue
+static uint32_t timer_distance(const struct timer *t, uint32_t theValue)
+{
+    uint32_t c = timer_cnt(t);
+    uint32_t top = timer_top(t);
+
+    if (c <= top)
+    {
+        if (theValue > top)
+            return 0;
+        return ((theValue >= c) ? theValue - c : top - c + 1 + theValue) + 1;
+    }
+    if (theValue >= c)                              // above TOP - counts on to MAX first
+        return theValue - c + 1;
+    if (theValue > top)
+        return 0;
+    return timer_max(t) - c + 1 + theValue + 1;
+}
+
+// timer clocks until the overflow flag is next set, 0 if it never is
+static uint32_t timer_wrap(const struct timer *t)
+{
+    uint32_t c = timer_cnt(t);
+    uint32_t top = timer_top(t);
+
+    if (c > top)
+        return timer_max(t) - c + 1;
+    if (timer_ctc(t))                               // cleared at TOP, TOV only at MAX
+        return 0;
+    return top - c + 1;
+}
+
+static uint32_t timer_next_clocks(const struct timer *t)
+{
+    uint32_t d[3] = { timer_distance(t, timer_ocra(t)), timer_distance(t, timer_ocrb(t)), timer_wrap(t) };
+    uint32_t best = 0;
+    int i;
+
+    for (i = 0; i < 3; i++)
+        if (d[i] && (!best || d[i] < best))
+            best = d[i];
+    return best;
+}
+
+// a new clock select restarts the prescaler phase, as the first count of a started timer does
+static void timer_observe(struct timer *t)
+{
+    uint8_t cs = *t->tccrb & 0x07;
+
+    if (cs != t->cs)
+    {
+        t->cs = cs;
+        t->phase = 0;
+    }
+    if (t->async && (GTCCR & (1<<PSRASY)))
+    {
+        GTCCR &= ~(1<<PSRASY);
+        t->phase = 0;
+    }
+}
+
+static sim_time_t timer_next(struct timer *t)
+{
+    sim_time_t period = timer_period(t);
+    uint32_t clocks;
+
+    timer_observe(t);
+    if (!period || !(clocks = timer_next_clocks(t)))
+        return sim_never;
+    return sim_now + clocks * period - t->phase;
+}
+
+// move the timer on by theTime, which never passes its next event
+static void timer_elapse(struct timer *t, sim_time_t theTime)
+{
+    sim_time_t period = timer_period(t);
+    uint32_t c, top, k, da, db, dw;
+    uint8_t hit = 0;
+
+    if (!period)
+        return;
+    theTime += t->phase;
+    k = theTime / period;
+    t->phase = theTime % period;
+    if (!k)
+        return;
+    da = timer_distance(t, timer_ocra(t));
+    db = timer_distance(t, timer_ocrb(t));
+    dw = timer_wrap(t);
+    c = timer_cnt(t);
+    top = timer_top(t);
+    if (c > top)
+    {
+        if (k <= timer_max(t) - c)
+            c += k;
+        else
+            c = (k - (timer_max(t) - c + 1)) % (top + 1);
+    }
+    else
+        c = (c + k) % (top + 1);
+    timer_set_cnt(t, c);
+    if (da == k)
+        hit |= (1<<OCF0A);
+    if (db == k)
+        hit |= (1<<OCF0B);
+    if (dw == k)
+        hit |= (1<<TOV0);
+    if (hit)
+        flags_set(t->flags, hit);
+}
+
+/*============================== Watchdog =================================*/
+static sim_time_t wdt_start;                        // last time-out or wdt_reset
+static uint8_t wdt_config;
+
+static sim_time_t wdt_period(void)
+{
+    uint8_t n = (WDTCSR & 0x07) | ((WDTCSR & (1<<WDP3)) ? 0x08 : 0);
+    uint64_t cycles = 2048ULL << (n > 9 ? 9 : n);
+
+    return cycles * (sim_Hz / 128000) * (1000000 + sim_wdt_ppm) / 1000000;
+}
+
+static sim_time_t wdt_next(void)
+{
+    uint8_t config = WDTCSR & ~(1<<WDIF);
+
+    if (config != wdt_config)                       // enabled or reprogrammed - count from here
+    {
+        wdt_config = config;
+        wdt_start = sim_now;
+    }
+    if (!(WDTCSR & ((1<<WDIE)|(1<<WDE))))
+        return sim_never;
+    return wdt_start + wdt_period();
+}
+
+void sim_wdt_reset(void)
+{
+    wdt_start = sim_now;
+}
+
+static void wdt_timeout(void)
+{
+    wdt_start = sim_now;
+    if (!(WDTCSR & (1<<WDIE)))
+        sim_fatal("watchdog reset");
+    WDTCSR |= (1<<WDIF);
+}
+
+/*============================== USART0 ===================================*/
+#define rx_queue_size       4096
+static uint8_t rx_queue[rx_queue_size];
+static size_t rx_head, rx_tail;
+static sim_time_t rx_free;                          // the line is idle from here on
+static sim_time_t rx_start_at = sim_never;          // start bit of the next queued frame
+static sim_time_t rx_end_at = sim_never;            // stop bit of the frame on the line
+static uint8_t rx_byte, rx_clocked;
+static uint8_t rx_fifo[2], rx_count;
+static uint8_t rx_window;                           // UDR0 holds a received byte for USART0_RX
+static sim_time_t tx_done_at = sim_never;
+static uint8_t tx_byte;
+
+static sim_time_t uart_frame(void)
+{
+    uint32_t cycles = 10UL * ((UCSR0A & (1<<U2X0)) ? 8 : 16) * (UBRR0 + 1UL);
+
+    return cycles * (sim_Hz / sim_f_cpu);
+}
+
+static void uart_out(uint8_t theByte)
+{
+    if (sim_uart_out_len < sizeof(sim_uart_out) - 1)
+    {
+        sim_uart_out[sim_uart_out_len++] = theByte;
+        sim_uart_out[sim_uart_out_len] = 0;
+    }
+}
+
+// pick up a byte the firmware has written to UDR0
+static void uart_sync(void)
+{
+    if (rx_window || UDR0 == udr_Empty)
+        return;
+    if (!(UCSR0B & (1<<TXEN0)))
+        ;                                           // transmitter off - the byte goes nowhere
+    else if (tx_done_at != sim_never)
+        sim_stats.tx_overruns++;
+    else
+    {
+        tx_byte = UDR0;
+        tx_done_at = sim_now + uart_frame();
+    }
+    UDR0 = udr_Empty;
+}
+
+static void rx_schedule(void)
+{
+    if (rx_start_at == sim_never && rx_end_at == sim_never && rx_head != rx_tail)
+        rx_start_at = (rx_free > sim_now) ? rx_free : sim_now;
+}
+
+static void pin_change(uint8_t theReg, uint8_t theChanged, uint8_t theMask)
+{
+    if (theChanged & theMask)
+        flags_set(sim_PCIFR, 1 << theReg);
+}
+
+static void uart_events(void)
+{
+    if (sim_now >= tx_done_at)
+    {
+        tx_done_at = sim_never;
+        (sim_uart_sink ? sim_uart_sink : uart_out)(tx_byte);
+    }
+    if (sim_now >= rx_start_at)                     // start bit - RXD falls
+    {
+        rx_start_at = sim_never;
+        rx_byte = rx_queue[rx_tail];
+        rx_tail = (rx_tail + 1) % rx_queue_size;
+        rx_end_at = sim_now + uart_frame();
+        rx_free = rx_end_at;
+        rx_clocked = (UCSR0B & (1<<RXEN0)) && !clk_io_stopped();
+        PIND &= ~(1<<PIND0);
+        pin_change(PCIE2, 1<<PIND0, PCMSK2);
+    }
+    if (sim_now >= rx_end_at)                       // stop bit
+    {
+        rx_end_at = sim_never;
+        PIND |= (1<<PIND0);
+        if (!rx_clocked || clk_io_stopped())
+            sim_stats.rx_lost++;
+        else if (rx_count < 2)
+        {
+            rx_fifo[rx_count++] = rx_byte;
+            UCSR0A |= (1<<RXC0);
+        }
+        else
+            UCSR0A |= (1<<DOR0);
+        rx_schedule();
+    }
+}
+
+void sim_uart_rx(const char *theData, size_t theLength)
+{
+    while (theLength--)
+    {
+        rx_queue[rx_head] = *theData++;
+        rx_head = (rx_head + 1) % rx_queue_size;
+    }
+    rx_schedule();
+}
+
+void sim_uart_clear(void)
+{
+    sim_uart_out_len = 0;
+    sim_uart_out[0] = 0;
+}
+
+/*============================== EEPROM ===================================*/
+#define ee_write_time       sim_us(3400)
+static sim_time_t ee_done_at = sim_never;
+static sim_time_t ee_master_until;                  // EEMPE is valid for four cycles
+
+static uint8_t *ee_cell(void)
+{
+    uint8_t *p = (uint8_t *)EEAR;
+
+    if (p < __start_host_eeprom || p >= __stop_host_eeprom)
+        sim_fatal("EEAR %p is outside the EEMEM section", (void *)p);
+    return p;
+}
+
+static void eeprom_strobe(uint8_t theValue)
+{
+    if (theValue & (1<<EERE))
+    {
+        if (EECR & (1<<EEPE))
+            sim_fatal("EEPROM read during a write");
+        EEDR = *ee_cell();
+        EECR &= ~(1<<EERE);
+    }
+    if ((theValue & (1<<EEMPE)) && !(theValue & (1<<EEPE)))
+        ee_master_until = sim_now + 4 * (sim_Hz / sim_f_cpu);
+    if (theValue & (1<<EEPE))
+    {
+        if (ee_done_at != sim_never)
+            sim_fatal("EEPROM write started during a write");
+        if (sim_now > ee_master_until || !(theValue & (1<<EEMPE)))
+            EECR &= ~(1<<EEPE);                     // no master enable - ignored
+        else
+        {
+            *ee_cell() = EEDR;
+            ee_done_at = sim_now + ee_write_time;
+        }
+        EECR &= ~(1<<EEMPE);
+    }
+}
+
+static void eeprom_events(void)
+{
+    if (sim_now >= ee_done_at)
+    {
+        ee_done_at = sim_never;
+        EECR &= ~(1<<EEPE);
+    }
+}
+
+void sim_eeprom_fill(uint8_t theValue)
+{
+    if (__start_host_eeprom)
+        memset(__start_host_eeprom, theValue, __stop_host_eeprom - __start_host_eeprom);
+}
+
+/*============================== TWI0 =====================================*/
+enum { twi_None, twi_Start, twi_Byte, twi_Stop };
+static sim_time_t twi_done_at = sim_never;
+static uint8_t twi_action;                          // the bus action under way
+static uint8_t twi_int;                             // TWINT
+static uint8_t twi_started;                         // a start has been sent and no stop yet
+static uint8_t twi_addressed;                       // the next byte is data, not SLA+R/W
+static uint8_t twi_acked;                           // the slave acknowledged its address
+static uint8_t twi_start_next;                      // TWSTA written while a stop was on the bus
+
+static sim_time_t twi_scl(void)
+{
+    static const uint8_t prescale[4] = { 1, 4, 16, 64 };
+
+    return (16 + 2UL * TWBR0 * prescale[TWSR0 & 0x03]) * (sim_Hz / sim_f_cpu);
+}
+
+static void twi_status(uint8_t theStatus)
+{
+    TWSR0 = theStatus | (TWSR0 & 0x03);
+}
+
+// pick up a write to TWCR0: a one in TWINT clears it and starts the action the other bits ask for
+static void twi_sync(void)
+{
+    uint8_t v;
+
+    if (TWCR0 & twcr_Seen)
+        return;
+    v = TWCR0;
+    if (!(v & (1<<TWEN)))                           // off - whatever was under way is dropped
+    {
+        twi_done_at = sim_never;
+        twi_action = twi_None;
+        twi_started = twi_int = 0;
+    }
+    else if ((v & (1<<TWINT)) && twi_action == twi_Stop && (v & (1<<TWSTA)))
+        twi_start_next = 1;                         // the start waits for the bus to be free
+    else if (v & (1<<TWINT))
+    {
+        if (twi_done_at != sim_never)
+            sim_fatal("TWCR0 written with TWINT while the TWI was busy");
+        twi_int = 0;
+        if (v & (1<<TWSTA))
+        {
+            twi_action = twi_Start;
+            twi_done_at = sim_now + twi_scl();
+        }
+        else if (v & (1<<TWSTO))
+        {
+            twi_action = twi_Stop;
+            twi_done_at = sim_now + twi_scl();
+        }
+        else if (twi_started)
+        {
+            twi_action = twi_Byte;
+            twi_done_at = sim_now + 9 * twi_scl();
+        }
+        else
+            sim_fatal("TWDR0 sent without a start condition");
+    }
+    TWCR0 = (v & ~(1<<TWINT)) | (twi_int << TWINT) | twcr_Seen;
+}
+
+static void twi_events(void)
+{
+    uint8_t ack;
+
+    twi_sync();
+    if (sim_now < twi_done_at)
+        return;
+    twi_done_at = sim_never;
+    switch (twi_action)
+    {
+    case twi_Start:
+        twi_status(twi_started ? 0x10 : 0x08);
+        twi_started = 1;
+        twi_addressed = 0;
+        twi_int = 1;
+        break;
+    case twi_Byte:
+        if (!twi_addressed)
+        {
+            twi_addressed = 1;
+            twi_acked = sim_twi_slave && sim_twi_slave(TWDR0, 1);
+            twi_status(twi_acked ? 0x18 : 0x20);    // SLA+W ACK / NACK
+        }
+        else
+        {
+            ack = twi_acked && sim_twi_slave(TWDR0, 0);
+            twi_status(ack ? 0x28 : 0x30);          // data ACK / NACK
+        }
+        twi_int = 1;
+        break;
+    case twi_Stop:
+        twi_started = 0;
+        twi_status(0xF8);
+        TWCR0 &= ~(1<<TWSTO);                       // cleared by the hardware, no TWINT
+        if (twi_start_next)
+        {
+            twi_start_next = 0;
+            twi_action = twi_Start;
+            twi_done_at = sim_now + twi_scl();
+            TWCR0 = (TWCR0 & ~(1<<TWINT)) | twcr_Seen;
+            return;
+        }
+        break;
+    }
+    twi_action = twi_None;
+    TWCR0 = (TWCR0 & ~(1<<TWINT)) | (twi_int << TWINT) | twcr_Seen;
+}
+
+/*============================== Interrupts ===============================*/
+#define sim_vector(name)    extern void name(void) __attribute__((weak));
+sim_vector(PCINT1_vect) sim_vector(PCINT2_vect) sim_vector(WDT_vect)
+sim_vector(TIMER2_COMPA_vect) sim_vector(TIMER2_COMPB_vect) sim_vector(TIMER2_OVF_vect)
+sim_vector(TIMER1_COMPA_vect) sim_vector(TIMER1_COMPB_vect) sim_vector(TIMER1_OVF_vect)
+sim_vector(TIMER0_COMPA_vect) sim_vector(TIMER0_COMPB_vect) sim_vector(TIMER0_OVF_vect)
+sim_vector(USART0_RX_vect) sim_vector(USART0_UDRE_vect) sim_vector(EE_READY_vect) sim_vector(TWI0_vect)
+sim_vector(TIMER3_COMPA_vect) sim_vector(TIMER3_COMPB_vect) sim_vector(TIMER3_OVF_vect)
+sim_vector(TIMER4_COMPA_vect) sim_vector(TIMER4_COMPB_vect) sim_vector(TIMER4_OVF_vect)
+
+enum { v_Timer, v_Pcint, v_Wdt, v_Rx, v_Udre, v_Eeprom, v_Twi };
+
+struct vector {
+    const char *name;
+    void (*handler)(void);
+    uint8_t kind, unit, bit;                        // timer number and flag bit, or PCIE bit
+    uint32_t count;
+};
+
+static struct vector vectors[] = {                  // in priority (vector table) order
+    { "PCINT1_vect", PCINT1_vect, v_Pcint, 0, PCIE1, 0 },
+    { "PCINT2_vect", PCINT2_vect, v_Pcint, 0, PCIE2, 0 },
+    { "WDT_vect", WDT_vect, v_Wdt, 0, 0, 0 },
+    { "TIMER2_COMPA_vect", TIMER2_COMPA_vect, v_Timer, 2, OCF2A, 0 },
+    { "TIMER2_COMPB_vect", TIMER2_COMPB_vect, v_Timer, 2, OCF2B, 0 },
+    { "TIMER2_OVF_vect", TIMER2_OVF_vect, v_Timer, 2, TOV2, 0 },
+    { "TIMER1_COMPA_vect", TIMER1_COMPA_vect, v_Timer, 1, OCF1A, 0 },
+    { "TIMER1_COMPB_vect", TIMER1_COMPB_vect, v_Timer, 1, OCF1B, 0 },
+    { "TIMER1_OVF_vect", TIMER1_OVF_vect, v_Timer, 1, TOV1, 0 },
+    { "TIMER0_COMPA_vect", TIMER0_COMPA_vect, v_Timer, 0, OCF0A, 0 },
+    { "TIMER0_COMPB_vect", TIMER0_COMPB_vect, v_Timer, 0, OCF0B, 0 },
+    { "TIMER0_OVF_vect", TIMER0_OVF_vect, v_Timer, 0, TOV0, 0 },
+    { "USART0_RX_vect", USART0_RX_vect, v_Rx, 0, 0, 0 },
+    { "USART0_UDRE_vect", USART0_UDRE_vect, v_Udre, 0, 0, 0 },
+    { "EE_READY_vect", EE_READY_vect, v_Eeprom, 0, 0, 0 },
+    { "TWI0_vect", TWI0_vect, v_Twi, 0, 0, 0 },
+    { "TIMER3_COMPA_vect", TIMER3_COMPA_vect, v_Timer, 3, OCF3A, 0 },
+    { "TIMER3_COMPB_vect", TIMER3_COMPB_vect, v_Timer, 3, OCF3B, 0 },
+    { "TIMER3_OVF_vect", TIMER3_OVF_vect, v_Timer, 3, TOV3, 0 },
+    { "TIMER4_COMPA_vect", TIMER4_COMPA_vect, v_Timer, 4, OCF4A, 0 },
+    { "TIMER4_COMPB_vect", TIMER4_COMPB_vect, v_Timer, 4, OCF4B, 0 },
+    { "TIMER4_OVF_vect", TIMER4_OVF_vect, v_Timer, 4, TOV4, 0 },
+};
+#define vector_count        (sizeof(vectors) / sizeof(vectors[0]))
+
+static int vector_pending(const struct vector *v)
+{
+    switch (v->kind)
+    {
+    case v_Timer:   return (flags_get(timers[v->unit].flags) & *timers[v->unit].timsk & (1 << v->bit)) != 0;
+    case v_Pcint:   return (PCICR & flags_get(sim_PCIFR) & (1 << v->bit)) != 0;
+    case v_Wdt:     return (WDTCSR & (1<<WDIE)) && (WDTCSR & (1<<WDIF));
+    case v_Rx:      return (UCSR0B & (1<<RXCIE0)) && (UCSR0A & (1<<RXC0));
+    case v_Udre:    return (UCSR0B & (1<<UDRIE0)) && (UCSR0B & (1<<TXEN0)) && tx_done_at == sim_never;
+    case v_Eeprom:  return (EECR & (1<<EERIE)) && !(EECR & (1<<EEPE));
+    case v_Twi:     return (TWCR0 & (1<<TWIE)) && twi_int;  // TWINT stays set - the handler clears it
+    }
+    return 0;
+}
+
+static struct vector *vector_next(void)
+{
+    size_t i;
+
+    for (i = 0; i < vector_count; i++)
+        if (vector_pending(&vectors[i]))
+            return &vectors[i];
+    return NULL;
+}
+
+static void vector_run(struct vector *v)
+{
+    if (!v->handler)
+        sim_fatal("%s is enabled but has no handler (the AVR would restart)", v->name);
+    switch (v->kind)                                // what the hardware does on entry
+    {
+    case v_Timer:   flags_clear(timers[v->unit].flags, 1 << v->bit); break;
+    case v_Pcint:   flags_clear(sim_PCIFR, 1 << v->bit); break;
+    case v_Wdt:     WDTCSR &= ~(1<<WDIF); break;
+    case v_Rx:      rx_window = 1; UDR0 = rx_fifo[0]; break;
+    case v_Udre:    UDR0 = udr_Empty; break;
+    }
+    v->count++;
+    sim_stats.interrupts++;
+    SREG &= ~sreg_I;
+    v->handler();
+    SREG |= sreg_I;                                 // reti
+    if (v->kind == v_Rx)                            // the handler has read UDR0
+    {
+        rx_fifo[0] = rx_fifo[1];
+        if (!--rx_count)
+            UCSR0A &= ~(1<<RXC0);
+        UDR0 = udr_Empty;
+        rx_window = 0;
+    }
+    uart_sync();
+    twi_sync();
+}
+
+// run the handlers of the pending interrupts, as long as the I bit allows
+static void dispatch(void)
+{
+    struct vector *v;
+
+    uart_sync();
+    twi_sync();
+    while ((SREG & sreg_I) && (v = vector_next()) != NULL)
+        vector_run(v);
+}
+
+uint32_t sim_interrupts(const char *theName)
+{
+    size_t i;
+
+    for (i = 0; i < vector_count; i++)
+        if (!strcmp(vectors[i].name, theName))
+            return vectors[i].count;
+    sim_fatal("no vector %s", theName);
+}
+
+/*============================== Time =====================================*/
+static sim_time_t next_event(void)
+{
+    sim_time_t next = sim_never, t;
+    size_t i;
+
+    for (i = 0; i < timer_count_of(timers); i++)
+        if ((t = timer_next(&timers[i])) < next)
+            next = t;
+    if ((t = wdt_next()) < next)
+        next = t;
+    if (!clk_io_stopped())
+    {
+        if (tx_done_at < next)
+            next = tx_done_at;
+        if (ee_done_at < next)
+            next = ee_done_at;
+        if (twi_done_at < next)
+            next = twi_done_at;
+    }
+    if (rx_start_at < next)
+        next = rx_start_at;
+    if (rx_end_at < next)
+        next = rx_end_at;
+    return next;
+}
+
+static void events_due(void)
+{
+    if (sim_now >= wdt_next())
+        wdt_timeout();
+    uart_events();
+    eeprom_events();
+    twi_events();
+}
+
+// move virtual time to theTime, setting flags on the way; runs no handlers
+static void advance_to(sim_time_t theTime)
+{
+    events_due();
+    while (sim_now < theTime)
+    {
+        sim_time_t next = next_event();
+        sim_time_t step;
+        size_t i;
+
+        if (next > theTime)
+            next = theTime;
+        step = next - sim_now;
+        for (i = 0; i < timer_count_of(timers); i++)
+            timer_elapse(&timers[i], step);
+        if (clk_io_stopped())                       // the USART and EEPROM wait for the clock
+        {
+            if (tx_done_at != sim_never)
+                tx_done_at += step;
+            if (ee_done_at != sim_never)
+                ee_done_at += step;
+            if (twi_done_at != sim_never)
+                twi_done_at += step;
+        }
+        if (waking)
+            sim_stats.waking += step;
+        else if (sleeping)
+            sim_stats.asleep[sleep_mode] += step;
+        else
+            sim_stats.awake += step;
+        sim_now = next;
+        events_due();
+    }
+}
+
+// spend theTime awake, running interrupts as they become due
+static void spend(sim_time_t theTime)
+{
+    sim_time_t end = sim_now + theTime;
+
+    dispatch();
+    while (sim_now < end)
+    {
+        sim_time_t next = next_event();
+
+        advance_to(next < end ? next : end);
+        dispatch();
+    }
+}
+
+double sim_seconds(void)
+{
+    return (double)sim_now / sim_Hz;
+}
+
+/*
+  Name:     sim_current_mA
+  Purpose:  estimate the average supply current from the time spent in each state
+  Entry:    (theFrom) sim_stats as they were at the start of the interval, NULL for sim_init
+  Exit:     mA, from the sim_mA_ / sim_uA_ figures at sim_f_cpu
+  Notes:    only port writes and delays take virtual time, so the awake share, and with it
+            the estimate, is a lower bound
+*/
+double sim_current_mA(const struct sim_stats *theFrom)
+{
+    static const struct sim_stats zero;
+    const struct sim_stats *from = theFrom ? theFrom : &zero;
+    double mhz = sim_f_cpu / 1e6;
+    double total = 0, charge = 0, t;
+    int mode;
+
+    t = (double)(sim_stats.awake - from->awake + sim_stats.waking - from->waking);
+    total += t;
+    charge += t * sim_mA_active_per_MHz * mhz;
+    for (mode = 0; mode < sim_modes; mode++)
+    {
+        t = (double)(sim_stats.asleep[mode] - from->asleep[mode]);
+        total += t;
+        charge += t * (mode == sim_PowerDown ? sim_uA_power_down / 1000 :
+                       mode == sim_PowerSave ? sim_uA_power_save / 1000 : sim_mA_idle_per_MHz * mhz);
+    }
+    return total ? charge / total : 0;
+}
+
+/*============================== CPU ======================================*/
+static ucontext_t host_context, firmware_context;
+static int (*firmware_entry)(void);
+static uint8_t firmware_state;                      // 0 none, 1 started, 2 returned from main
+static uint8_t in_firmware;
+static sim_time_t run_until;
+static char firmware_stack[1 << 20];
+
+static void firmware_trampoline(void)
+{
+    firmware_entry();
+    firmware_state = 2;                             // like avr-libc: cli and spin forever
+    SREG &= ~sreg_I;
+    in_firmware = 0;
+    swapcontext(&firmware_context, &host_context);
+    abort();
+}
+
+void sim_start(int (*theEntry)(void))
+{
+    firmware_entry = theEntry;
+    getcontext(&firmware_context);
+    firmware_context.uc_stack.ss_sp = firmware_stack;
+    firmware_context.uc_stack.ss_size = sizeof(firmware_stack);
+    firmware_context.uc_link = NULL;
+    makecontext(&firmware_context, firmware_trampoline, 0);
+    firmware_state = 1;
+}
+
+void sim_run(sim_time_t theTime)
+{
+    run_until = sim_now + theTime;
+    if (firmware_state == 1)
+    {
+        in_firmware = 1;
+        swapcontext(&host_context, &firmware_context);
+        in_firmware = 0;
+    }
+    if (sim_now < run_until)                        // main() has returned
+        advance_to(run_until);
+}
+
+int sim_run_until(int (*theTest)(void), sim_time_t theLimit)
+{
+    sim_time_t end = sim_now + theLimit;
+
+    while (!theTest())
+    {
+        if (sim_now >= end)
+            return 0;
+        sim_run(sim_us(10));
+    }
+    return 1;
+}
+
+static int wake_pending(void)
+{
+    return (SREG & sreg_I) && vector_next() != NULL;
+}
+
+void sim_sleep_cpu(void)
+{
+    sim_time_t woken = sim_never;                   // end of the oscillator start-up
+
+    if (!(SMCR & (1<<SE)))                          // SLEEP without SE is a NOP
+        return;
+    dispatch();                                     // pending - wakes at once
+    if (!(SREG & sreg_I))
+        sim_fatal("sleep_cpu with interrupts disabled");
+    sleeping = 1;
+    sleep_mode = (SMCR >> SM0) & 0x07;
+    sim_stats.sleeps++;
+    for (;;)
+    {
+        sim_time_t target;
+
+        if (wake_pending())
+        {
+            if (woken == sim_never)
+            {
+                woken = sim_now + (clk_io_stopped() && sleep_mode != 6 && sleep_mode != 7
+                                   ? sim_startup_cycles * (sim_Hz / sim_f_cpu) : 0);
+                waking = 1;
+            }
+            if (sim_now >= woken)
+                break;
+            target = woken;
+        }
+        else
+            target = next_event();
+        if (in_firmware && target > run_until)
+        {
+            if (sim_now < run_until)
+                target = run_until;
+            else                                    // back to the harness until sim_run
+            {
+                in_firmware = 0;
+                swapcontext(&firmware_context, &host_context);
+                continue;
+            }
+        }
+        if (target == sim_never)
+            sim_fatal("asleep with nothing left to wake the CPU");
+        advance_to(target);
+    }
+    sleeping = 0;
+    waking = 0;
+    dispatch();
+}
+
+void sim_hal_write(volatile uint8_t *theReg, uint8_t theValue)
+{
+    dispatch();
+    *theReg = theValue;
+    sim_stats.writes++;
+    if (theReg == &EECR)
+        eeprom_strobe(theValue);
+    if (sim_port_hook && (theReg == &PORTB || theReg == &PORTC || theReg == &PORTD || theReg == &PORTE ||
+                          theReg == &DDRB || theReg == &DDRC || theReg == &DDRD || theReg == &DDRE))
+        sim_port_hook();
+    spend(2 * (sim_Hz / sim_f_cpu));                // OUT / SBI / CBI
+}
+
+void sim_delay_us(double theTime)
+{
+    sim_time_t t = sim_us(theTime);
+
+    sim_stats.delayed += t;
+    spend(t);
+}
+
+/*============================== Set-up ===================================*/
+void sim_buttons(uint8_t thePressed)
+{
+    uint8_t pins = (PINC & 0xF0) | (~thePressed & 0x0F);   // active low
+
+    pin_change(PCIE1, pins ^ PINC, PCMSK1);
+    PINC = pins;
+}
+
+void sim_fatal(const char *theFormat, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "sim: %.6f s: ", sim_seconds());
+    va_start(args, theFormat);
+    vfprintf(stderr, theFormat, args);
+    va_end(args);
+    fputc('\n', stderr);
+    exit(3);
+}
+
+void sim_init(uint32_t theClock)
+{
+    size_t i;
+
+    sim_f_cpu = theClock;
+    sim_startup_cycles = (theClock == 16000000UL) ? 16384 : 6;  // crystal, or the internal RC of tick_rtc
+    sim_now = 0;
+    memset(&sim_stats, 0, sizeof(sim_stats));
+    for (i = 0; i < sim_flag_registers; i++)
+    {
+        flag_bits[i] = 0;
+        flag_latch[i] = flag_Latch;
+    }
+    for (i = 0; i < timer_count_of(timers); i++)
+    {
+        timers[i].cs = 0;
+        timers[i].phase = 0;
+    }
+    PINB = 0xFF;                                    // inputs pulled up, buttons released, RXD idle
+    PINC = 0x7F;
+    PIND = 0xFF;
+    PINE = 0x0F;
+    SREG = 0;
+    MCUSR = (1<<PORF);
+    UDR0 = udr_Empty;
+    UCSR0A = (1<<UDRE0);
+    rx_head = rx_tail = 0;
+    rx_count = 0;
+    rx_free = wdt_start = ee_master_until = 0;      // times of the previous run, which sim_now restarts
+    rx_start_at = rx_end_at = tx_done_at = ee_done_at = twi_done_at = sim_never;
+    TWCR0 = twcr_Seen;
+    twi_action = twi_None;
+    twi_int = twi_started = twi_start_next = 0;
+    sim_twi_slave = NULL;
+    sim_uart_clear();
+    sim_eeprom_fill(0xFF);                          // erased
+    sleeping = waking = 0;
+    wdt_config = 0;
+}
@@ -0,0 +1,84 @@
+/*
+  Discrete-event model of the ATmega328PB peripherals used by the firmware
+
+  Virtual time advances only when the firmware sleeps, busy-waits or writes a port through
+  hal_write (two CPU cycles each); everything else it does takes no time.  Between those
+  points the simulator jumps straight to the next event - a timer compare match or
+  overflow, a watchdog time-out, the end of a USART frame or of an EEPROM write - so a
+  simulated hour of a sleeping clock costs a few thousand steps.
+
+  The firmware's main() runs in its own context: sim_run(t) lets it go until it sleeps at or
+  after t from now and returns to the caller, which may then press buttons, type on the
+  serial line or look at the LCD model before running it on.
+*/
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint64_t sim_time_t;
+
+#define sim_Hz              512000000ULL            // units per second - 16 MHz, 8 MHz and 32.768 kHz divide it
+#define sim_us(t)           ((sim_time_t)((t) * (double)(sim_Hz / 1000000)))
+#define sim_ms(t)           ((sim_time_t)(t) * (sim_Hz / 1000))
+#define sim_s(t)            ((sim_time_t)(t) * sim_Hz)
+#define sim_never           UINT64_MAX
+#define sim_to_us(t)        ((double)(t) / (double)(sim_Hz / 1000000))
+
+#define sim_Idle            0                       // sleep modes, as SMCR SM2..SM0
+#define sim_PowerDown       2
+#define sim_PowerSave       3
+#define sim_modes           8
+
+// typical supply current of the ATmega328PB at 5 V and 25 C (datasheet characteristics), for
+//   the estimates of sim_current_mA only - the board's regulator and LCD are not included
+#define sim_mA_active_per_MHz   0.56                // awake, and waking from a deep sleep
+#define sim_mA_idle_per_MHz     0.16
+#define sim_uA_power_down       6.0                 // with the watchdog oscillator running
+#define sim_uA_power_save       1.5                 // with Timer2 on the 32.768 kHz crystal
+
+struct sim_stats {
+    sim_time_t awake;                               // not in sleep_cpu: busy-waits and port writes
+    sim_time_t delayed;                             // part of awake spent in _delay_us / _delay_ms
+    sim_time_t waking;                              // oscillator start-up after a deep sleep
+    sim_time_t asleep[sim_modes];                   // per sleep mode
+    uint32_t sleeps;                                // sleep_cpu calls that went to sleep
+    uint32_t interrupts;                            // handlers run
+    uint32_t writes;                                // hal_write calls
+    uint32_t rx_lost;                               // frames that arrived while the USART had no clock
+    uint32_t tx_overruns;                           // UDR0 written while the transmitter was busy
+};
+
+extern sim_time_t sim_now;
+extern struct sim_stats sim_stats;
+extern uint32_t sim_f_cpu;
+extern uint32_t sim_startup_cycles;                 // oscillator start-up after power-down / power-save
+extern int32_t sim_wdt_ppm;                         // error of the 128 kHz watchdog oscillator
+extern void (*sim_uart_sink)(uint8_t);              // each byte the USART has sent (default: sim_uart_out)
+extern void (*sim_port_hook)(void);                 // after every hal_write to a PORT or DDR register
+extern int (*sim_twi_slave)(uint8_t, int);          // a byte the TWI master sent, non-zero for the
+                                                    //   address byte; returns non-zero for ACK
+extern char sim_uart_out[];                         // text sent by the firmware, NUL terminated
+extern size_t sim_uart_out_len;
+
+void sim_init(uint32_t);
+void sim_start(int (*)(void));
+void sim_run(sim_time_t);
+int sim_run_until(int (*)(void), sim_time_t);
+void sim_buttons(uint8_t);
+void sim_uart_rx(const char *, size_t);
+void sim_uart_clear(void);
+void sim_eeprom_fill(uint8_t);
+uint32_t sim_interrupts(const char *);
+double sim_seconds(void);
+double sim_current_mA(const struct sim_stats *);
+void sim_fatal(const char *, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+// used by the stand-in avr-libc headers and host/hal.h
+void sim_hal_write(volatile uint8_t *, uint8_t);
+void sim_delay_us(double);
+void sim_sleep_cpu(void);
+void sim_wdt_reset(void);
+
+#endif
@@ -0,0 +1,215 @@
+/*
+  Host tests of the alarm pool and the calendar alarms, driven through the serial commands
+*/
+#include "firmware.h"
+#include "check.h"
+
+#ifdef tick_wdt
+#define alarm_error_ppm     2000                    // the residual of the calibration (tick_wdt) ...
+#define alarm_wdt_drift_ppm 500                     // ... of the wall clock alone, in 64 uS Timer1 counts
+#else
+#define alarm_error_ppm     1                       // crystal-exact dividers: rounding only
+#endif
+
+static void boot(void)
+{
+    firmware_boot();
+    sim_run(sim_ms(500));
+}
+
+static void test_countdown_fires(void)
+{
+    boot();
+    CHECK(!strcmp(firmware_command("C 003"), "OK"));
+    CHECK(!strcmp(firmware_command("G"), "OK"));
+    CHECK(countdown_running());
+    CHECK_EQ(alarm_heap_size, 1);
+    sim_run(sim_s(4));
+    CHECK(!countdown_running());
+    CHECK(alarm_ringing(alarm_ui));
+    CHECK_EQ(alarm_heap_size, 0);
+}
+
+// a calendar alarm on the pool alarm that is counting down ends the countdown and leaves
+//   nothing behind in the heap
+static void test_calendar_alarm_on_countdown(void)
+{
+    uint8_t round;
+
+    boot();
+    CHECK(!strcmp(firmware_command("C 200"), "OK"));
+    for (round = 0; round < alarm_count + 2; round++)
+    {
+        CHECK(!strcmp(firmware_command("G"), "OK"));
+        CHECK_EQ(alarm_heap_size, 1);
+        CHECK(!strcmp(firmware_command("T 12 5958"), "OK"));
+        CHECK(!strcmp(firmware_command("A 0 1300 7F 0 01"), "OK"));
+        sim_run(sim_s(3));
+        CHECK(alarm_ringing(alarm_ui));
+        CHECK(!countdown_running());
+        CHECK_EQ(alarm_heap_size, 0);
+        CHECK(!strcmp(firmware_command("X"), "OK"));
+        CHECK(!alarm_ringing(alarm_ui));
+    }
+    CHECK(firmware_lcd_settled());
+}
+
+// at midnight ev_NewDay moves the cursor on before ev_ClockAlarm is handled - the 00:00
+//   alarm must still be the one that rings
+static void test_midnight_alarm(void)
+{
+    boot();
+    CHECK(!strcmp(firmware_command("A 0 0000 7F 1 01"), "OK"));
+    CHECK(!strcmp(firmware_command("A 1 0700 7F 2 02"), "OK"));
+    CHECK(!strcmp(firmware_command("T 23 5958"), "OK"));
+    sim_run(sim_s(3));
+    CHECK(alarm_ringing(1));
+    CHECK(!alarm_ringing(2));
+    CHECK_EQ(rtc_next_hour, 0x07);
+    CHECK_EQ(rtc_next_minute, 0x00);
+    CHECK(!strcmp(firmware_command("T 06 5958"), "OK"));
+    sim_run(sim_s(3));
+    CHECK(alarm_ringing(2));
+}
+
+// pool alarms armed with P pull only their own bits low, while the countdown runs on
+static void test_pool_alarms(void)
+{
+    boot();
+    CHECK(!strcmp(firmware_command("C 010"), "OK"));
+    CHECK(!strcmp(firmware_command("G"), "OK"));
+    CHECK(!strcmp(firmware_command("P 1 003 01"), "OK"));
+    CHECK(!strcmp(firmware_command("P 2 005 06"), "OK"));
+    CHECK_EQ(alarm_heap_size, 3);
+    sim_run(sim_s(4));
+    CHECK(alarm_ringing(1));
+    CHECK(!alarm_ringing(2));
+    CHECK_EQ(PORTE, 0xFE);
+    CHECK(!strcmp(firmware_command("P 1 003 01"), "ERR"));   // still ringing
+    sim_run(sim_s(2));
+    CHECK(alarm_ringing(2));
+    CHECK_EQ(PORTE, 0xF8);
+    CHECK(!strcmp(firmware_command("X 1"), "OK"));
+    CHECK_EQ(PORTE, 0xF9);
+    CHECK(countdown_running());
+    CHECK(!alarm_ringing(alarm_ui));
+    CHECK(!strcmp(firmware_command("X 2"), "OK"));
+    CHECK_EQ(PORTE, 0xFF);
+    CHECK(!strcmp(firmware_command("P 1 003 01"), "OK"));
+    CHECK(!strcmp(firmware_command("X 1"), "OK"));    // cancelled before it fires
+    CHECK_EQ(alarm_heap_size, 1);
+    sim_run(sim_s(5));
+    CHECK(!alarm_ringing(1));
+    CHECK(alarm_ringing(alarm_ui));
+    CHECK_EQ(PORTE, 0xFF & ~alarm_ui_output);
+    CHECK_EQ(alarm_heap_size, 0);
+}
+
+#ifdef tick_rtc
+#define tick_name           "tick_rtc (Timer2, 32.768 kHz crystal)"
+#elif defined(tick_wdt)
+#define tick_name           "tick_wdt (calibrated watchdog)"
+#else
+#define tick_name           "tick_timer1 (Timer1 CTC on F_CPU)"
+#endif
+
+static uint8_t second_seen;
+
+static int countdown_ringing(void)
+{
+    return alarm_ringing(alarm_ui);
+}
+
+static int second_changed(void)
+{
+    return rtc_second != second_seen;
+}
+
+// virtual time of the next change of rtc_second, within 10 uS
+static sim_time_t next_second(void)
+{
+    second_seen = rtc_second;
+    CHECK(sim_run_until(second_changed, sim_ms(2100)));
+    return sim_now;
+}
+
+static void report_error(const char *theWhat, double theMeasured, double theTrue)
+{
+    double ppm = (theMeasured - theTrue) / theTrue * 1e6;
+
+    printf("%s, %s: %+.3f ppm, %+.4f S/hour\n", tick_name, theWhat, ppm, ppm * 3600 / 1e6);
+    CHECK(ppm > -alarm_error_ppm && ppm < alarm_error_ppm);
+}
+
+// an hour of the wall clock and a 999 S countdown against virtual time; the error is taken
+//   between edges of rtc_second, and from G to the ring, each found to 10 uS - positive when
+//   the firmware's seconds are short (the clock runs fast, the countdown ends early)
+static void test_timing_error(void)
+{
+    sim_time_t start, started;
+
+    boot();
+    CHECK(!strcmp(firmware_command("T 00 0000"), "OK"));
+    start = next_second();
+    sim_run(sim_s(3599));
+    started = next_second();
+    CHECK_EQ(rtc_hour, 0x01);
+    CHECK_EQ(rtc_minute, 0x00);
+    report_error("wall clock over an hour", 3600, sim_to_us(started - start) / 1e6);
+
+    CHECK(!strcmp(firmware_command("C 999"), "OK"));
+    start = next_second();                          // G just after a tick, as a user would
+    CHECK(!strcmp(firmware_command("G"), "OK"));
+    sim_run(sim_s(997));
+    CHECK(sim_run_until(countdown_ringing, sim_s(3)));
+    report_error("999 S countdown", 999, sim_to_us(sim_now - start) / 1e6);
+}
+
+#ifdef tick_wdt
+// a watchdog oscillator 10 % fast and 10 % slow: after the first calibration the wall clock
+//   keeps within alarm_wdt_drift_ppm over an hour; the average current is set against the
+//   busy-wait build, which never slept
+static void test_wdt_error(void)
+{
+    static const int32_t errors[] = { 100000, -100000 };
+    struct sim_stats from;
+    sim_time_t start, end;
+    double ppm;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(errors) / sizeof(errors[0]); i++)
+    {
+        sim_wdt_ppm = errors[i];
+        boot();
+        CHECK(!strcmp(firmware_command("T 00 0000"), "OK"));
+        start = next_second();
+        from = sim_stats;
+        sim_run(sim_s(3599));
+        end = next_second();
+        CHECK_EQ(rtc_hour, 0x01);
+        ppm = (3600 - sim_to_us(end - start) / 1e6) / (sim_to_us(end - start) / 1e6) * 1e6;
+        printf("watchdog %+.0f %%: drift %+.1f ppm, %+.3f S/hour, %.1f uA average "
+               "(busy-wait build: %.2f mA)\n", errors[i] / 1e4, ppm, ppm * 3600 / 1e6,
+               sim_current_mA(&from) * 1000, sim_mA_active_per_MHz * sim_f_cpu / 1e6);
+        CHECK(ppm > -alarm_wdt_drift_ppm && ppm < alarm_wdt_drift_ppm);
+        CHECK(sim_current_mA(&from) < 0.1);         // power-down between the watchdog periods
+    }
+    sim_wdt_ppm = 0;
+}
+#endif
+
+int main(void)
+{
+    static const struct check_case cases[] = {
+        { "alarm countdown fires", test_countdown_fires },
+        { "alarm calendar alarm on a running countdown", test_calendar_alarm_on_countdown },
+        { "alarm midnight rings the 00:00 alarm", test_midnight_alarm },
+        { "alarm pool alarms on their own outputs", test_pool_alarms },
+        { "alarm timing error of the tick over an hour", test_timing_error },
+#ifdef tick_wdt
+        { "alarm watchdog 10 % off: drift after calibration", test_wdt_error },
+#endif
+    };
+
+    return check_all(cases, check_count(cases));
+}
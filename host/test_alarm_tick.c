@@ -0,0 +1,111 @@
+/*
+  Host benchmark of alarm_tick with 1, 8 and 64 pool alarms armed besides alarm_ui: the time
+  of a tick at which nothing is due (an increment and one compare with the heap top, so the
+  same for any number armed) and of a tick that fires an alarm (an O(log n) heap removal,
+  most of its time going to the simulated PORTE write and the buzzer).  The times are of
+  the host CPU - the firmware itself is timed in cycles by make bench, as part of the tick
+  interrupt handler.
+*/
+#include <time.h>
+
+#define alarm_count         65                      // alarm_ui and 64 more
+#include "firmware.h"
+#include "check.h"
+
+#define tick_batch          20000                   // ticks timed together
+#define tick_rounds         25                      // the fastest batch is reported
+#define tick_idle_spread    2                       // slowest idle tick of 64 over that of 1
+
+static double now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// an empty pool, then theCount alarms after alarm_ui, the first due in theFirst seconds and
+//   the others a second apart
+static void arm(uint8_t theCount, uint16_t theFirst)
+{
+    uint8_t i;
+
+    memset(alarms, 0, sizeof(alarms));
+    alarm_heap_size = 0;
+    alarm_now = 0;
+    for (i = 0; i < theCount; i++)
+        alarm_arm(alarm_ui + 1 + i, theFirst + i, 1 << (i & 7));
+}
+
+// nanoseconds per tick with nothing due
+static double idle_tick_ns(uint8_t theCount)
+{
+    double best = 1e30, ns;
+    uint8_t round;
+    uint16_t i;
+
+    for (round = 0; round < tick_rounds; round++)
+    {
+        arm(theCount, tick_batch + 1);
+        ns = now_ns();
+        for (i = 0; i < tick_batch; i++)
+        {
+            alarm_tick();
+            __asm__ __volatile__("" ::: "memory");  // one call per tick, not folded
+        }
+        ns = (now_ns() - ns) / tick_batch;
+        if (ns < best)
+            best = ns;
+    }
+    CHECK_EQ(alarm_heap_size, theCount);
+    return best;
+}
+
+// nanoseconds per tick that fires one alarm, the heap holding theCount when the first fires
+static double firing_tick_ns(uint8_t theCount)
+{
+    double best = 1e30, ns;
+    uint8_t round, i;
+
+    for (round = 0; round < tick_rounds; round++)
+    {
+        arm(theCount, 1);
+        ns = now_ns();
+        for (i = 0; i < theCount; i++)
+        {
+            alarm_tick();
+            __asm__ __volatile__("" ::: "memory");
+        }
+        ns = (now_ns() - ns) / theCount;
+        if (ns < best)
+            best = ns;
+        CHECK_EQ(alarm_heap_size, 0);
+        CHECK(alarm_ringing(theCount));
+    }
+    return best;
+}
+
+static void test_tick_cost(void)
+{
+    static const uint8_t counts[] = { 1, 8, 64 };
+    double idle[3];
+    uint8_t i;
+
+    firmware_power_on();                            // registers only - alarm_tick is called here
+    for (i = 0; i < 3; i++)
+    {
+        idle[i] = idle_tick_ns(counts[i]);
+        printf("alarm_tick, %2u alarms armed: %.2f nS with nothing due, %.2f nS firing one\n",
+               counts[i], idle[i], firing_tick_ns(counts[i]));
+    }
+    CHECK(idle[2] < tick_idle_spread * idle[0] + 1);
+}
+
+int main(void)
+{
+    static const struct check_case cases[] = {
+        { "alarm_tick cost at 1, 8 and 64 armed alarms", test_tick_cost },
+    };
+
+    return check_all(cases, check_count(cases));
+}
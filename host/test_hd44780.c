@@ -0,0 +1,199 @@
+/*
+  Host tests of the HD44780 model itself, driven pin by pin without the firmware
+*/
+#include <string.h>
+#include <avr/io.h>
+#include "sim.h"
+#include "hd44780.h"
+#include "check.h"
+
+#define rs_bit  0                                   // PORTB0, E = PORTB1, D4..D7 = PORTD4..7
+#define e_bit   1
+#define rw_bit  2                                   // PORTB2, attached only by the read tests
+
+static void setup(void)
+{
+    sim_init(16000000UL);
+    DDRB = (1<<rs_bit)|(1<<e_bit);
+    DDRD = 0xF0;
+    hd44780_attach(&PORTB, rs_bit, &PORTB, e_bit, &PORTD, 4);
+}
+
+static void nibble(uint8_t theRs, uint8_t theNibble)
+{
+    sim_hal_write(&PORTB, (PORTB & ~(1<<rs_bit)) | (theRs << rs_bit));
+    sim_hal_write(&PORTD, (PORTD & 0x0F) | (theNibble << 4));
+    sim_hal_write(&PORTB, PORTB | (1<<e_bit));
+    sim_delay_us(1);
+    sim_hal_write(&PORTB, PORTB & ~(1<<e_bit));
+    sim_delay_us(1);
+}
+
+static void byte(uint8_t theRs, uint8_t theByte, double theWait)
+{
+    nibble(theRs, theByte >> 4);
+    nibble(theRs, theByte & 0x0F);
+    sim_delay_us(theWait);
+}
+
+static void init_4bit(void)
+{
+    sim_delay_us(50000);
+    nibble(0, 0x3);
+    sim_delay_us(4200);
+    nibble(0, 0x3);
+    sim_delay_us(110);
+    nibble(0, 0x3);
+    sim_delay_us(40);
+    nibble(0, 0x2);                                 // 4-bit, still one strobe
+    sim_delay_us(40);
+    byte(0, 0x28, 40);                              // 4-bit, 2 lines
+    byte(0, 0x08, 40);
+    byte(0, 0x01, 1600);
+    byte(0, 0x06, 40);
+    byte(0, 0x0C, 40);
+}
+
+static void test_init_sequence(void)
+{
+    setup();
+    init_4bit();
+    CHECK_EQ(hd44780.violations, 0);
+    CHECK(hd44780.four_bit);
+    CHECK(hd44780.two_lines);
+    CHECK(hd44780.display_on);
+    CHECK_EQ(hd44780.resets, 4);                    // the one selecting 4 bits included
+    CHECK_EQ(hd44780.strobes, 4 + 2 * 5);
+}
+
+static void test_power_on_wait(void)
+{
+    setup();
+    sim_delay_us(20000);                            // only 20 mS after power-on
+    nibble(0, 0x3);
+    CHECK_EQ(hd44780.violations, 1);
+}
+
+static void test_reset_wait(void)
+{
+    setup();
+    sim_delay_us(50000);
+    nibble(0, 0x3);
+    sim_delay_us(1000);                             // 4.1 mS needed
+    nibble(0, 0x3);
+    CHECK_EQ(hd44780.violations, 1);
+}
+
+static void test_execution_time(void)
+{
+    setup();
+    init_4bit();
+    byte(1, 'A', 20);                               // 37 uS needed
+    byte(1, 'B', 40);
+    CHECK_EQ(hd44780.violations, 1);
+    byte(0, 0x01, 1000);                            // Clear takes 1.52 mS
+    byte(1, 'C', 40);
+    CHECK_EQ(hd44780.violations, 2);
+}
+
+static void test_strobe_timing(void)
+{
+    setup();
+    init_4bit();
+    sim_hal_write(&PORTD, (PORTD & 0x0F) | 0x40);
+    sim_hal_write(&PORTB, PORTB | (1<<rs_bit) | (1<<e_bit));    // RS and E together - no set-up
+    sim_hal_write(&PORTB, PORTB & ~(1<<e_bit));                 // 125 nS pulse
+    CHECK(hd44780.violations >= 2);
+}
+
+static void test_ddram_lines(void)
+{
+    uint8_t i;
+
+    setup();
+    init_4bit();
+    byte(0, 0x80 | 0x26, 40);                       // two before the end of line one
+    for (i = 0; i < 4; i++)
+        byte(1, 'a' + i, 40);
+    CHECK_EQ(hd44780.violations, 0);
+    CHECK_EQ(hd44780.ddram[38], 'a');
+    CHECK_EQ(hd44780.ddram[39], 'b');
+    CHECK_EQ(hd44780.ddram[40], 'c');               // 0x27 runs into 0x40
+    CHECK_EQ(hd44780_cell(1, 1), 'd');
+    byte(0, 0x80 | 0x30, 40);                       // not a DDRAM address with two lines
+    CHECK_EQ(hd44780.violations, 1);
+}
+
+// one byte read in two strobes with RW high, the data lines turned round to inputs
+static uint8_t read_byte(uint8_t theRs)
+{
+    uint8_t theByte = 0;
+    uint8_t i;
+
+    sim_hal_write(&DDRD, 0x00);
+    sim_hal_write(&PORTD, 0x00);
+    sim_hal_write(&PORTB, (PORTB & ~(1<<rs_bit)) | (theRs << rs_bit) | (1<<rw_bit));
+    for (i = 0; i < 2; i++)
+    {
+        sim_hal_write(&PORTB, PORTB | (1<<e_bit));
+        sim_delay_us(1);
+        theByte = (theByte << 4) | (PIND >> 4);
+        sim_hal_write(&PORTB, PORTB & ~(1<<e_bit));
+        sim_delay_us(1);
+    }
+    sim_hal_write(&PORTB, PORTB & ~(1<<rw_bit));
+    sim_hal_write(&DDRD, 0xF0);
+    return theByte;
+}
+
+static void test_reads(void)
+{
+    setup();
+    DDRB |= 1<<rw_bit;
+    hd44780_attach_rw(&PORTB, rw_bit);
+    init_4bit();
+    byte(0, 0x80 | 0x05, 40);
+    byte(1, 'A', 0);
+    CHECK_EQ(read_byte(0), 0x80 | 0x06);            // busy, the address already moved on
+    sim_delay_us(40);
+    CHECK_EQ(read_byte(0), 0x06);
+    byte(0, 0x80 | 0x05, 40);
+    CHECK_EQ(read_byte(1), 'A');
+    CHECK_EQ(read_byte(0), 0x06);                   // a data read steps the address too
+    CHECK_EQ(hd44780.reads, 8);
+    CHECK_EQ(hd44780.characters, 1);                // and is not taken for a write
+    CHECK_EQ(hd44780.violations, 0);
+    hd44780.stuck_busy = 1;
+    CHECK(read_byte(0) & 0x80);
+}
+
+static void test_cgram(void)
+{
+    setup();
+    init_4bit();
+    byte(0, 0x40 | 8, 40);                          // slot 1, row 0
+    byte(1, 0x1F, 40);
+    byte(1, 0xF1, 40);                              // only 5 bits are kept
+    byte(0, 0x80, 40);
+    byte(1, 0x09, 40);
+    CHECK_EQ(hd44780.cgram[8], 0x1F);
+    CHECK_EQ(hd44780.cgram[9], 0x11);
+    CHECK_EQ(hd44780_cell(0, 0), 0x09);
+    CHECK_EQ(hd44780.violations, 0);
+}
+
+int main(void)
+{
+    static const struct check_case cases[] = {
+        { "hd44780 init sequence", test_init_sequence },
+        { "hd44780 power-on wait", test_power_on_wait },
+        { "hd44780 reset wait", test_reset_wait },
+        { "hd44780 execution time", test_execution_time },
+        { "hd44780 strobe timing", test_strobe_timing },
+        { "hd44780 ddram lines", test_ddram_lines },
+        { "hd44780 cgram", test_cgram },
+        { "hd44780 busy flag, address and data reads", test_reads },
+    };
+
+    return check_all(cases, check_count(cases));
+}
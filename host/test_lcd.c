@@ -0,0 +1,306 @@
+/*
+  Host tests of the LCD driver: the firmware's lcd_init_4d, transmit queue and frame buffer
+  against the HD44780 model
+*/
+#include "firmware.h"
+#include "check.h"
+
+static void boot(void)
+{
+    firmware_boot();
+    sim_run(sim_ms(500));
+}
+
+static void test_boot(void)
+{
+    boot();
+    if (hd44780.violations)
+        fprintf(stderr, "first violation: %s\n", hd44780.first_violation);
+    CHECK_EQ(hd44780.violations, 0);
+    CHECK(hd44780.four_bit);
+    CHECK(hd44780.two_lines);
+    CHECK(hd44780.display_on);
+    CHECK(!hd44780.cursor_on);
+    CHECK(firmware_lcd_settled());
+}
+
+static int czas_changed(void)
+{
+    return czas != time_default;
+}
+
+// the first frame, with the display switched on
+static int first_frame_shown(void)
+{
+    return hd44780.display_on && hd44780_cell(0, 0) != ' ' && firmware_lcd_settled();
+}
+
+// from power-on: the first frame, a button held down from the start, a command typed at once;
+//   the LCD reset sequence runs in the background and the first frame waits for its end, so
+//   the input is live as soon as main() sleeps
+static void test_boot_times(void)
+{
+    sim_time_t display, counted, answered;
+
+    firmware_boot();
+    CHECK(sim_run_until(first_frame_shown, sim_ms(500)));
+    display = sim_now;
+
+    firmware_boot();
+    sim_buttons(firmware_S2);
+    CHECK(sim_run_until(czas_changed, sim_ms(500)));
+    counted = sim_now;
+    sim_buttons(0);
+
+    firmware_boot();
+    CHECK(!strncmp(firmware_command("N"), "N ", 2));
+    answered = sim_now;
+
+    printf("boot: first frame on the display after %.2f mS, a held button counted after %.2f mS, "
+           "a command answered after %.2f mS\n", sim_to_us(display) / 1000,
+           sim_to_us(counted) / 1000, sim_to_us(answered) / 1000);
+    CHECK(display >= sim_ms(40));                   // the HD44780 power-on wait ...
+    CHECK(display < sim_ms(200));                   // ... and the reset sequence
+    CHECK(counted < sim_ms(40));                    // the four debouncing samples only
+    CHECK(answered < sim_ms(20));                   // the CR, the command and the reply
+    CHECK_EQ(hd44780.violations, 0);
+}
+
+static int reset_done(void)
+{
+    return hd44780.display_on;                      // the last instruction of the sequence
+}
+
+static int bus_written(void)
+{
+    return hd44780.instructions + hd44780.characters > 0;
+}
+
+// the first frame - its CGRAM uploads, cursor moves and 32 cells - sent in one go straight
+//   after the reset sequence; bytes per second of the queue in this build's LCD mode
+static void test_throughput(void)
+{
+    uint32_t instructions, characters;
+    sim_time_t start;
+    double time;
+
+    firmware_power_on();
+    sim_start(firmware_main);
+    CHECK(sim_run_until(reset_done, sim_ms(500)));
+    instructions = hd44780.instructions;
+    characters = hd44780.characters;
+    hd44780.instructions = hd44780.characters = 0;
+    CHECK(sim_run_until(bus_written, sim_ms(10)));  // from the first byte of the frame ...
+    start = sim_now;
+    CHECK(sim_run_until(firmware_lcd_settled, sim_ms(100)));    // ... to the last
+    time = sim_to_us(sim_now - start) / 1e6;
+    printf("throughput (%s): %u instructions and %u characters in %.2f mS, %.0f bytes/s, "
+           "%.0f characters/s\n",
+#ifdef lcd_use_busy_flag
+           "busy flag",
+#elif defined(lcd_i2c)
+           "PCF8574 at 100 kHz",
+#else
+           "fixed delays",
+#endif
+           (unsigned)hd44780.instructions, (unsigned)hd44780.characters, time * 1000,
+           (hd44780.instructions + hd44780.characters) / time, hd44780.characters / time);
+    CHECK(hd44780.characters >= lcd_Cells);
+    CHECK_EQ(hd44780.violations, 0);
+    hd44780.instructions += instructions;
+    hd44780.characters += characters;
+}
+
+static int czas_shown(void)
+{
+    return czas != time_default && firmware_lcd_settled();
+}
+
+static void test_button_redraw(void)
+{
+    uint32_t strobes;
+    sim_time_t pressed, delayed;
+
+    boot();
+    CHECK_EQ(czas, time_default);
+    strobes = hd44780.strobes;
+    delayed = sim_stats.delayed;
+    pressed = sim_now;
+    sim_buttons(firmware_S2);                       // one step up
+    CHECK(sim_run_until(czas_shown, sim_ms(100)));
+    printf("S2 redraw: %u strobes, %.1f uS busy-waiting, on the display %.2f mS after the press\n",
+           (unsigned)(hd44780.strobes - strobes), sim_to_us(sim_stats.delayed - delayed),
+           sim_to_us(sim_now - pressed) / 1000);
+    CHECK(sim_now - pressed >= sim_ms(32));         // four samples 8 mS apart agree on the press ...
+    CHECK(sim_now - pressed < sim_ms(50));          // ... then the redraw
+    CHECK(hd44780.strobes - strobes < 2 * 40);      // one changed big digit, not the whole screen
+    sim_buttons(0);
+    sim_run(sim_ms(100));
+    CHECK_EQ(czas, bcd_increment(time_default));
+    if (hd44780.violations)
+        fprintf(stderr, "first violation: %s\n", hd44780.first_violation);
+    CHECK_EQ(hd44780.violations, 0);
+}
+
+static void test_glitch_ignored(void)
+{
+    boot();
+    sim_buttons(firmware_S2);                       // two samples, not the four debouncing needs
+    sim_run(sim_ms(12));
+    sim_buttons(0);
+    sim_run(sim_ms(100));
+    CHECK_EQ(czas, time_default);
+    CHECK(firmware_lcd_settled());
+}
+
+#ifndef lcd_i2c
+static void test_direct_write_is_checked(void)
+{
+    boot();
+    CHECK(firmware_lcd_settled());
+    hal_clear_bits(lcd_RS_port, 1<<lcd_RS_bit);     // two instructions without the 40 uS between them
+    lcd_write_4(lcd_Home);
+    lcd_write_4(lcd_Home << 4);
+    lcd_write_4(lcd_DisplayOn);
+    lcd_write_4(lcd_DisplayOn << 4);
+    CHECK(hd44780.violations > 0);
+}
+#endif
+
+// text from flash goes through the frame buffer and the queue, clipped at the last cell
+static void test_puts_flash(void)
+{
+    boot();
+    lcd_fb_goto(lcd_Cells - 4);
+    lcd_fb_puts_P(PSTR("HOST"));
+    CHECK_EQ(lcd_fb_pos, lcd_Cells);
+    lcd_fb_puts_P(PSTR("X"));                       // past the end: dropped
+    CHECK_EQ(lcd_fb_pos, lcd_Cells);
+    CHECK(!memcmp(&lcd_shadow[lcd_Cells - 4], "HOST", 4));
+    CHECK(memcmp(&hd44780.ddram[40 + 12], "HOST", 4));  // not on the display yet
+    lcd_fb_flush();
+    CHECK(lcd_tx_busy());                           // queued, not written synchronously
+    // main() is asleep, with tick_rtc in power-save where Timer0 stops; a command wakes it and
+    //   it picks the sleep mode again, as it would after its own flush
+    CHECK(!strncmp(firmware_command("N"), "N ", 2));
+    CHECK(sim_run_until(firmware_lcd_settled, sim_ms(50)));
+    CHECK(!memcmp(&hd44780.ddram[40 + 12], "HOST", 4));
+    CHECK_EQ(hd44780.violations, 0);
+}
+
+static void test_idle_redraws_seconds_only(void)
+{
+    uint32_t strobes;
+
+    boot();
+    sim_run(sim_s(2));
+    strobes = hd44780.strobes;
+    sim_run(sim_s(10));                             // no countdown: only the clock's seconds change
+    CHECK(hd44780.strobes - strobes <= 10 * 2 * 3); // address and at most two digits a second
+    CHECK(firmware_lcd_settled());
+}
+
+#ifdef trace_buffer
+#define marks_max           8
+
+static struct { uint8_t data; sim_time_t at; } marks[marks_max];
+static uint8_t marks_count, marks_seen;
+static sim_time_t display_on_at;
+
+// the trace_Main records, time-stamped as they are written - the trace buffer itself wraps
+//   long before the first frame is on the display
+static int watch_marks(void)
+{
+    for (; marks_seen != trace_head; marks_seen = (marks_seen + 1) & (trace_size - 1))
+        if (trace_log[marks_seen].code == trace_Main && marks_count < marks_max)
+        {
+            marks[marks_count].data = trace_log[marks_seen].data;
+            marks[marks_count++].at = sim_now;
+        }
+    if (hd44780.display_on && !display_on_at)
+        display_on_at = sim_now;
+    return 0;
+}
+
+// a frame queued while the reset sequence is still running: the lcd_init_4d section ends
+//   when the sequence has been executed, not when the frame behind it has been sent
+static void test_init_span(void)
+{
+    static const uint8_t order[] = { bench_LcdInit, bench_Redraw, bench_LcdInit | bench_End,
+                                     bench_Redraw | bench_End };
+    uint8_t i;
+
+    marks_count = 0;
+    marks_seen = trace_head;
+    display_on_at = 0;
+    firmware_boot();
+    sim_run_until(watch_marks, sim_ms(20));
+    CHECK(!hd44780.display_on);
+    sim_uart_clear();
+    sim_uart_rx("C 100\r", 6);                     // countdown_show behind the sequence
+    sim_run_until(watch_marks, sim_ms(300));
+    CHECK(!strncmp(sim_uart_out, "OK\r\n", 4));
+    CHECK(firmware_lcd_settled());
+    CHECK_EQ(marks_count, sizeof(order));
+    for (i = 0; i < sizeof(order) && i < marks_count; i++)
+        CHECK_EQ(marks[i].data, order[i]);
+    printf("lcd_init_4d section: %.2f mS, Display On executed %.1f uS before its end, "
+           "frame on the display %.2f mS later\n", sim_to_us(marks[2].at) / 1000,
+           sim_to_us(marks[2].at - display_on_at), sim_to_us(marks[3].at - marks[2].at) / 1000);
+    CHECK(marks[2].at >= display_on_at + sim_us(37));   // the execution time of Display On ...
+    CHECK(marks[2].at < display_on_at + sim_us(200));   // ... and a count or two of Timer0
+    CHECK(marks[3].at > marks[2].at + sim_ms(1));       // the frame took its own time
+    CHECK_EQ(hd44780.violations, 0);
+}
+#endif
+
+#ifdef lcd_use_busy_flag
+static int queue_empty(void)
+{
+    return !lcd_tx_busy();
+}
+
+// a display that never clears its busy flag slows the queue down but does not stop it
+static void test_busy_flag_stuck(void)
+{
+    boot();
+    hd44780.stuck_busy = 1;
+    sim_buttons(firmware_S2);
+    sim_run(sim_ms(100));
+    sim_buttons(0);
+    CHECK(sim_run_until(queue_empty, sim_ms(500)));
+    CHECK(lcd_busy_timeouts > 0);
+    hd44780.stuck_busy = 0;
+    CHECK(firmware_lcd_settled());
+    CHECK_EQ(hd44780.violations, 0);                // the fallback waits as long as Clear takes
+    lcd_busy_timeouts = 0;
+    CHECK(!strcmp(firmware_command("C 123"), "OK"));  // a display that recovers is polled again
+    CHECK(sim_run_until(firmware_lcd_settled, sim_ms(50)));
+    CHECK(hd44780.reads > 0);
+    CHECK_EQ(lcd_busy_timeouts, 0);
+}
+#endif
+
+int main(void)
+{
+    static const struct check_case cases[] = {
+        { "lcd init on the model", test_boot },
+        { "lcd boot: time to first input and first display", test_boot_times },
+        { "lcd throughput of the first frame", test_throughput },
+        { "lcd redraw after S2", test_button_redraw },
+        { "lcd no redraw for a 12 mS glitch on S2", test_glitch_ignored },
+#ifndef lcd_i2c                                     // lcd_write_4 only fills the burst buffer
+        { "lcd model flags a direct write", test_direct_write_is_checked },
+#endif
+        { "lcd puts from flash through the queue", test_puts_flash },
+        { "lcd idle redraws the seconds only", test_idle_redraws_seconds_only },
+#ifdef trace_buffer
+        { "lcd init section ends with the sequence, not the frame", test_init_span },
+#endif
+#ifdef lcd_use_busy_flag
+        { "lcd busy flag stuck: falls back to the fixed delay", test_busy_flag_stuck },
+#endif
+    };
+
+    return check_all(cases, check_count(cases));
+}
@@ -0,0 +1,113 @@
+/*
+  Host tests of the sleep modes: the share of an hour spent awake and in each sleep mode,
+  from sim_stats, and the average current worked out from those shares (sim_current_mA) -
+  an idle hour with only the wall clock running, and an hour of back-to-back countdowns
+*/
+#include "firmware.h"
+#include "check.h"
+
+#ifdef tick_rtc
+#define power_tick          "tick_rtc"
+#define power_deepest       sim_PowerSave           // Timer2 keeps the seconds
+#define power_idle_max_mA   0.05
+#elif defined(tick_wdt)
+#define power_tick          "tick_wdt"
+#define power_deepest       sim_PowerDown           // the watchdog keeps the seconds
+#define power_idle_max_mA   0.05
+#else
+#define power_tick          "tick_timer1"
+#define power_deepest       sim_Idle                // the Timer1 tick needs the I/O clock
+#define power_idle_max_mA   3.0
+#endif
+
+static const char *const mode_names[sim_modes] = {
+    "idle", "ADC noise", "power-down", "power-save", "4", "5", "standby", "ext standby"
+};
+
+static void boot(void)
+{
+    firmware_boot();
+    sim_run(sim_ms(500));
+}
+
+static double share(sim_time_t theTime, sim_time_t theTotal)
+{
+    return 100.0 * theTime / theTotal;
+}
+
+// the shares since theFrom, printed; returns the share of power_deepest in per cent
+static double report(const char *theWhat, const struct sim_stats *theFrom)
+{
+    sim_time_t awake = sim_stats.awake - theFrom->awake;
+    sim_time_t waking = sim_stats.waking - theFrom->waking;
+    sim_time_t asleep[sim_modes], total = awake + waking;
+    int mode;
+
+    for (mode = 0; mode < sim_modes; mode++)
+        total += asleep[mode] = sim_stats.asleep[mode] - theFrom->asleep[mode];
+    printf("%s, %s: awake %.4f %%, waking %.4f %%", power_tick, theWhat, share(awake, total),
+           share(waking, total));
+    for (mode = 0; mode < sim_modes; mode++)
+        if (asleep[mode])
+            printf(", %s %.4f %%", mode_names[mode], share(asleep[mode], total));
+    printf("; %u wake-ups, %.1f uA average\n", (unsigned)(sim_stats.sleeps - theFrom->sleeps),
+           sim_current_mA(theFrom) * 1000);
+    CHECK(total >= sim_s(3600));
+    return share(asleep[power_deepest], total);
+}
+
+static void test_idle_hour(void)
+{
+    struct sim_stats from;
+
+    boot();
+    sim_run(sim_s(5));                              // the LCD and the settings settle
+    from = sim_stats;
+    sim_run(sim_s(3600));
+    CHECK(report("idle hour", &from) > 99);
+    CHECK(sim_current_mA(&from) < power_idle_max_mA);
+}
+
+static int ringing(void)
+{
+    return alarm_ringing(alarm_ui);
+}
+
+// 999 S countdowns, each silenced as it rings and started again, with the display showing
+//   every second
+static void test_countdown_hour(void)
+{
+    struct sim_stats from;
+    sim_time_t end;
+    uint8_t rounds = 0;
+
+    boot();
+    CHECK(!strcmp(firmware_command("C 999"), "OK"));
+    from = sim_stats;
+    end = sim_now + sim_s(3600);
+    while (sim_now < end)
+    {
+        if (!countdown_running())
+        {
+            CHECK(!strcmp(firmware_command("G"), "OK"));
+            rounds++;
+        }
+        sim_run(sim_s(1));
+        if (ringing())
+            CHECK(!strcmp(firmware_command("X"), "OK"));
+    }
+    CHECK_EQ(rounds, 4);
+    report("countdown hour", &from);
+    CHECK(sim_current_mA(&from) < sim_mA_active_per_MHz * sim_f_cpu / 1e6);
+    CHECK_EQ(hd44780.violations, 0);
+}
+
+int main(void)
+{
+    static const struct check_case cases[] = {
+        { "power idle hour: mode shares and current", test_idle_hour },
+        { "power countdown hour: mode shares and current", test_countdown_hour },
+    };
+
+    return check_all(cases, check_count(cases));
+}
@@ -0,0 +1,268 @@
+/*
+  Host scenario tests: scripted use of the timer over simulated minutes and days, and
+  randomized sequences of buttons, commands and waits checked against invariants after
+  every step.  Each prints how many simulated hours it ran per real second.
+*/
+#include <time.h>
+#include "firmware.h"
+#include "check.h"
+
+#define scenario_seed       20240226u               // fixed, so a failure can be replayed
+#define scenario_steps      400
+
+static struct timespec started;
+static unsigned step;                               // of test_random_use, for the failure report
+
+static void boot(void)
+{
+    firmware_boot();
+    sim_run(sim_ms(500));
+    clock_gettime(CLOCK_MONOTONIC, &started);
+}
+
+static void report(const char *theName)
+{
+    struct timespec now;
+    double real;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    real = (now.tv_sec - started.tv_sec) + (now.tv_nsec - started.tv_nsec) / 1e9;
+    printf("%s: %.1f simulated hours in %.2f S, %.0f simulated hours per second\n",
+           theName, sim_seconds() / 3600, real, sim_seconds() / 3600 / real);
+}
+
+static void press(uint8_t theButtons, unsigned theHold_ms)
+{
+    sim_buttons(theButtons);
+    sim_run(sim_ms(theHold_ms));
+    sim_buttons(0);
+    sim_run(sim_ms(100));
+}
+
+static int ui_ringing(void)
+{
+    return alarm_ringing(alarm_ui);
+}
+
+// like sim_run_until, a second at a time - alarms fire on the second, and the 10 uS steps
+//   of sim_run_until would take hours of real time to cross simulated days
+static int run_until_ringing(sim_time_t theLimit)
+{
+    sim_time_t end = sim_now + theLimit;
+
+    while (!ui_ringing())
+    {
+        if (sim_now >= end)
+            return 0;
+        sim_run(sim_s(1));
+    }
+    return 1;
+}
+
+// C 200 started with S1, snoozed twice with S4, the second snooze cancelled with X
+static void test_snooze_twice(void)
+{
+    sim_time_t start;
+
+    boot();
+    CHECK(!strcmp(firmware_command("C 200"), "OK"));
+    press(firmware_S1, 100);
+    start = sim_now;
+    CHECK(countdown_running());
+    sim_run(sim_s(198));
+    CHECK(countdown_running());
+    CHECK(!ui_ringing());
+    CHECK_EQ(PORTE, 0xFF);
+    CHECK(run_until_ringing(sim_s(3)));
+    CHECK(sim_now - start >= sim_s(199));
+    CHECK_EQ(PORTE, 0xFF & ~alarm_ui_output);
+
+    press(firmware_S4, 100);                        // first snooze
+    CHECK(!ui_ringing());
+    CHECK(countdown_running());
+    CHECK_EQ(PORTE, 0xFF);
+    start = sim_now;
+    CHECK(run_until_ringing(sim_s(bcd_to_seconds(time_snooze) + 2)));
+    CHECK(sim_now - start >= sim_s(bcd_to_seconds(time_snooze) - 1));
+
+    press(firmware_S4, 100);                        // second snooze, then cancelled
+    CHECK(countdown_running());
+    sim_run(sim_s(5));
+    CHECK(!strcmp(firmware_command("X"), "OK"));
+    CHECK(!countdown_running());
+    sim_run(sim_s(bcd_to_seconds(time_snooze) + 5));
+    CHECK(!ui_ringing());
+    CHECK_EQ(PORTE, 0xFF);
+    CHECK_EQ(alarm_heap_size, 0);
+    CHECK_EQ(czas, 0x200);
+    CHECK(firmware_lcd_settled());
+    CHECK_EQ(hd44780.violations, 0);
+    report("snooze twice");
+}
+
+// a weekday alarm over a week from 26 February 2024 (a Monday), across the leap day
+static void test_weekday_alarm(void)
+{
+    uint8_t days[8] = { 0 };
+    uint8_t rings = 0, day;
+    sim_time_t end;
+
+    boot();
+    CHECK(!strcmp(firmware_command("D 24 0226 0"), "OK"));
+    CHECK(!strcmp(firmware_command("T 00 0000"), "OK"));
+    CHECK(!strcmp(firmware_command("A 0 0730 1F 0 FF"), "OK"));
+    end = sim_now + sim_s(7 * 86400 + 3600);       // an hour over, for the drift of tick_wdt
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    while (rings < 10 && run_until_ringing(end - sim_now))
+    {
+        CHECK_EQ(rtc_hour, 0x07);
+        CHECK_EQ(rtc_minute, 0x30);
+        CHECK(rtc_weekday < 5);
+        days[rtc_weekday]++;
+        rings++;
+        CHECK(!strcmp(firmware_command("X"), "OK"));
+        CHECK_EQ(PORTE, 0xFF);
+    }
+    CHECK_EQ(rings, 5);
+    for (day = 0; day < 5; day++)
+        CHECK_EQ(days[day], 1);
+    CHECK_EQ(rtc_month, 0x03);
+    CHECK_EQ(rtc_day, 0x04);
+    CHECK_EQ(rtc_weekday, 0);
+    CHECK(firmware_lcd_settled());
+    CHECK_EQ(hd44780.violations, 0);
+    report("weekday alarm");
+}
+
+static unsigned pick(unsigned theCount)
+{
+    return (unsigned)rand() % theCount;
+}
+
+static uint8_t random_bcd(uint8_t theLimit)
+{
+    uint8_t value = pick(theLimit + 1);
+
+    return (value / 10) << 4 | value % 10;
+}
+
+// the alarm heap, the BCD variables, the calendar and the outputs are consistent
+static void check_invariants(void)
+{
+    uint8_t i, armed = 0;
+    int before = check_failures;
+
+    CHECK(alarm_heap_size <= alarm_count);
+    for (i = 0; i < alarm_heap_size; i++)
+    {
+        CHECK_EQ(alarms[alarm_heap[i]].heap_pos, i);
+        CHECK(alarms[alarm_heap[i]].state & alarm_Armed);
+        if (i)
+            CHECK((int16_t)(alarms[alarm_heap[i]].expiry - alarms[alarm_heap[(i - 1) / 2]].expiry) >= 0);
+    }
+    for (i = 0; i < alarm_count; i++)
+        if (alarms[i].state & alarm_Armed)
+            armed++;
+    CHECK_EQ(armed, alarm_heap_size);
+    CHECK(bcd_valid(czas, 3));
+    CHECK(bcd_valid(drzemka, 3));
+    CHECK(bcd_valid(odliczanie, 3));
+    CHECK(bcd_valid(rtc_hour, 2) && rtc_hour <= 0x23);
+    CHECK(bcd_valid(rtc_minute, 2) && rtc_minute <= 0x59);
+    CHECK(bcd_valid(rtc_second, 2) && rtc_second <= 0x59);
+    CHECK(rtc_month >= 0x01 && rtc_month <= 0x12);
+    CHECK(rtc_day >= 0x01 && rtc_day <= rtc_month_last(rtc_year, rtc_month));
+    CHECK(rtc_weekday < 7);
+    CHECK_EQ(PORTE, ui_ringing() ? 0xFF & ~alarm_ui_output : 0xFF);
+    CHECK_EQ(hd44780.violations, 0);
+    if (check_failures != before)
+        fprintf(stderr, "at step %u (seed %u)\n", step, scenario_seed);
+}
+
+// hours go by, and someone silences the alarm within a minute of it starting to ring - the
+//   buzzer costs a hundred interrupts per simulated second
+static void wait_attended(sim_time_t theTime)
+{
+    sim_time_t end = sim_now + theTime;
+
+    while (sim_now < end)
+    {
+        if (ui_ringing())
+        {
+            check_invariants();
+            CHECK(!strcmp(firmware_command("X"), "OK"));
+        }
+        sim_run(end - sim_now < sim_s(60) ? end - sim_now : sim_s(60));
+    }
+}
+
+// one random thing a user or a host could do
+static void random_step(void)
+{
+    char line[32];
+    uint16_t left;
+
+    switch (pick(12))
+    {
+        case 0: press(firmware_S1, 100); break;
+        case 1: press(firmware_S2, 100 + pick(3000)); break;
+        case 2: press(firmware_S3, 100 + pick(3000)); break;
+        case 3: press(firmware_S4, 100); break;
+        case 4: press(firmware_S4, 1500); break;
+        case 5:
+        snprintf(line, sizeof(line), "C %03X", pick(0x1000));
+        CHECK(!strcmp(firmware_command(line),
+                      bcd_valid(strtoul(line + 2, NULL, 16), 3) && !countdown_running() ? "OK" : "ERR"));
+        break;
+        case 6:
+        if (pick(2))
+            CHECK(!strcmp(firmware_command("G"), !countdown_running() && !ui_ringing() ? "OK" : "ERR"));
+        else
+            CHECK(!strcmp(firmware_command("X"), "OK"));
+        break;
+        case 7:
+        snprintf(line, sizeof(line), "T %02X %02X%02X", random_bcd(23), random_bcd(59), random_bcd(59));
+        CHECK(!strcmp(firmware_command(line), "OK"));
+        break;
+        case 8:
+        snprintf(line, sizeof(line), "A %u %02X%02X %02X 0 FF", pick(clock_alarm_count),
+                 random_bcd(23), random_bcd(59), pick(0x80));
+        CHECK(!strcmp(firmware_command(line), "OK"));
+        break;
+        case 9:                                     // a countdown left alone rings on time
+        if (countdown_running() && !ui_ringing())
+        {
+            left = bcd_to_seconds(odliczanie);
+            CHECK(run_until_ringing(sim_s(left + 2)));
+        }
+        break;
+        case 10: sim_run(sim_ms(pick(60000))); break;
+        default: wait_attended(sim_s(pick(6 * 3600))); break;
+    }
+}
+
+static void test_random_use(void)
+{
+    srand(scenario_seed);
+    boot();
+    for (step = 0; step < scenario_steps; step++)
+    {
+        random_step();
+        check_invariants();
+    }
+    CHECK(!strcmp(firmware_command("X"), "OK"));
+    sim_run(sim_s(2));
+    CHECK(firmware_lcd_settled());
+    report("random use");
+}
+
+int main(void)
+{
+    static const struct check_case cases[] = {
+        { "scenario C 200, snooze twice, cancel", test_snooze_twice },
+        { "scenario weekday alarm over a week", test_weekday_alarm },
+        { "scenario random buttons, commands and waits", test_random_use },
+    };
+
+    return check_all(cases, check_count(cases));
+}
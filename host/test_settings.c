@@ -0,0 +1,81 @@
+/*
+  Host tests of the settings store: which EEPROM records settings_load accepts at power-on
+*/
+#include "firmware.h"
+#include "check.h"
+
+static void boot_with(uint8_t theSlot, uint16_t theCzas, uint16_t theDrzemka, uint8_t theMelody)
+{
+    struct settings theRecord = { 1, theCzas, theDrzemka, theMelody, 0 };
+
+    firmware_power_on();
+    theRecord.crc = settings_crc(&theRecord);
+    memcpy(&settings_log[theSlot], &theRecord, sizeof(theRecord));
+    sim_start(firmware_main);
+    sim_run(sim_ms(500));
+}
+
+static void test_erased(void)
+{
+    firmware_boot();
+    sim_run(sim_ms(500));
+    CHECK_EQ(czas, time_default);
+    CHECK_EQ(drzemka, time_snooze);
+}
+
+static void test_zeroed(void)
+{
+    firmware_power_on();
+    sim_eeprom_fill(0x00);                          // a chip shipped or wiped with zeros
+    sim_start(firmware_main);
+    sim_run(sim_ms(500));
+    CHECK_EQ(czas, time_default);
+    CHECK_EQ(drzemka, time_snooze);
+}
+
+static void test_valid_record(void)
+{
+    boot_with(5, 0x123, 0x045, melody_Rise);
+    CHECK_EQ(czas, 0x123);
+    CHECK_EQ(drzemka, 0x045);
+    CHECK_EQ(alarms[alarm_ui].melody, melody_Rise);
+    CHECK_EQ(settings_slot, 5);
+}
+
+static void test_out_of_range_records(void)
+{
+    boot_with(0, 0x0AF, 0x045, melody_Beep);        // not BCD
+    CHECK_EQ(czas, time_default);
+    boot_with(0, 0x1000, 0x045, melody_Beep);       // four digits
+    CHECK_EQ(czas, time_default);
+    boot_with(0, 0x123, 0x000, melody_Beep);        // no snooze time
+    CHECK_EQ(drzemka, time_snooze);
+    boot_with(0, 0x123, 0x045, 7);                  // no such melody
+    CHECK_EQ(czas, time_default);
+}
+
+static void test_saved_after_change(void)
+{
+    struct settings theRecord;
+
+    firmware_boot();
+    sim_run(sim_ms(500));
+    CHECK(!strcmp(firmware_command("C 321"), "OK"));
+    sim_run(sim_s(settings_delay_s + 2));
+    memcpy(&theRecord, &settings_log[settings_slot], sizeof(theRecord));
+    CHECK_EQ(theRecord.czas, 0x321);
+    CHECK_EQ(theRecord.crc, settings_crc(&theRecord));
+}
+
+int main(void)
+{
+    static const struct check_case cases[] = {
+        { "settings erased EEPROM keeps the defaults", test_erased },
+        { "settings zeroed EEPROM keeps the defaults", test_zeroed },
+        { "settings valid record restored", test_valid_record },
+        { "settings out-of-range records rejected", test_out_of_range_records },
+        { "settings change saved", test_saved_after_change },
+    };
+
+    return check_all(cases, check_count(cases));
+}
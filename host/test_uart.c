@@ -0,0 +1,144 @@
+/*
+  Host tests of the serial commands: replies, and ERR for every field out of range
+*/
+#include "firmware.h"
+#include "check.h"
+
+static void boot(void)
+{
+    firmware_boot();
+    sim_run(sim_ms(500));
+}
+
+static void expect(const char *theLine, const char *theReply)
+{
+    const char *reply = firmware_command(theLine);
+
+    if (strcmp(reply, theReply))
+    {
+        fprintf(stderr, "\"%s\" -> \"%s\", expected \"%s\"\n", theLine, reply, theReply);
+        check_failures++;
+    }
+}
+
+static void test_countdown_time(void)
+{
+    boot();
+    expect("C 015", "OK");
+    CHECK_EQ(czas, 0x015);
+    expect("C 0AF", "ERR");
+    expect("C 9F9", "ERR");
+    expect("C 01", "ERR");
+    expect("C", "ERR");
+    CHECK_EQ(czas, 0x015);
+    expect("C 999", "OK");
+    CHECK(!strncmp(firmware_command("?"), "S 999 000 I ", 12));
+}
+
+static void test_time_of_day(void)
+{
+    boot();
+    expect("T 23 5958", "OK");
+    CHECK_EQ(rtc_hour, 0x23);
+    expect("T 25 0000", "ERR");
+    expect("T 24 0000", "ERR");
+    expect("T 1A 0000", "ERR");
+    expect("T 12 6000", "ERR");
+    expect("T 12 0060", "ERR");
+    expect("T 12 0A00", "ERR");
+    CHECK_EQ(rtc_hour, 0x23);
+    CHECK_EQ(rtc_minute, 0x59);
+}
+
+static void test_date(void)
+{
+    boot();
+    expect("D 24 0229 3", "OK");                    // 2024 is a leap year
+    CHECK_EQ(rtc_day, 0x29);
+    expect("D 23 0229 3", "ERR");
+    expect("D 24 0001 0", "ERR");                   // month 0 would read month_days[-1]
+    expect("D 24 1301 0", "ERR");                   // and 0x13 past its end
+    expect("D 24 0A01 0", "ERR");
+    expect("D 24 0431 0", "ERR");
+    expect("D 24 0100 0", "ERR");
+    expect("D 24 0101 7", "ERR");
+    expect("D 2F 0101 0", "ERR");
+    expect("D 24 0226 3", "ERR");                   // a Monday, not a Thursday
+    expect("D 24 0226 0", "OK");
+    CHECK_EQ(rtc_weekday, 0);
+    expect("D 00 0101 5", "OK");                    // a Saturday, counted in 1999
+    expect("D 00 0301 2", "OK");                    // 2000 is a leap year
+    expect("D 99 1231 6", "ERR");
+    expect("D 99 1231 3", "OK");
+    CHECK_EQ(rtc_year, 0x99);
+    CHECK_EQ(rtc_month, 0x12);
+    CHECK_EQ(rtc_weekday, 3);
+}
+
+// rtc_weekday_of agrees with the weekday rtc_new_day counts, every day from 2000 to 2099
+static void test_weekday_of(void)
+{
+    uint32_t days;
+
+    rtc_set_date(0x00, 0x01, 0x01, 5);
+    for (days = 0; days < 36525; days++)
+    {
+        if (rtc_weekday_of(rtc_year, rtc_month, rtc_day) != rtc_weekday)
+        {
+            fprintf(stderr, "20%02X-%02X-%02X: %u, counted %u\n", rtc_year, rtc_month, rtc_day,
+                    rtc_weekday_of(rtc_year, rtc_month, rtc_day), rtc_weekday);
+            check_failures++;
+            return;
+        }
+        rtc_new_day();
+    }
+    CHECK_EQ(rtc_year, 0x00);                       // wrapped round to 2000
+}
+
+static void test_calendar_alarm(void)
+{
+    boot();
+    expect("A 0 0730 1F 1 01", "OK");
+    CHECK_EQ(clock_alarms[0].hour, 0x07);
+    expect("A 4 0730 1F 1 01", "ERR");
+    expect("A 0 2400 1F 1 01", "ERR");
+    expect("A 0 0760 1F 1 01", "ERR");
+    expect("A 0 07A0 1F 1 01", "ERR");
+    expect("A 0 0730 80 1 01", "ERR");
+    expect("A 0 0730 1F 8 01", "ERR");
+    CHECK_EQ(clock_alarms[0].minute, 0x30);
+}
+
+static void test_unknown(void)
+{
+    boot();
+    expect("Z", "ERR");
+    expect("R 1", "OK");
+    CHECK(alarm_ringing(1));
+    expect("R 8", "ERR");
+    expect("P 0 010 01", "ERR");
+    expect("P 8 010 01", "ERR");
+    expect("P 1 0A0 01", "ERR");
+    expect("P 1 000 01", "ERR");
+    expect("P 2 010", "ERR");
+    expect("P 2 010 01", "OK");
+    CHECK(alarms[2].state & alarm_Armed);
+    CHECK_EQ(alarms[2].output, 0x01);
+    expect("X 2", "OK");
+    CHECK(!(alarms[2].state & alarm_Armed));
+    expect("X 8", "ERR");
+}
+
+int main(void)
+{
+    static const struct check_case cases[] = {
+        { "uart C checks the BCD digits", test_countdown_time },
+        { "uart T checks hour, minute and second", test_time_of_day },
+        { "uart D checks the date against the calendar", test_date },
+        { "uart D weekday of every date of the century", test_weekday_of },
+        { "uart A checks the alarm fields", test_calendar_alarm },
+        { "uart other commands", test_unknown },
+    };
+
+    return check_all(cases, check_count(cases));
+}
@@ -0,0 +1,125 @@
+/*
+  Benchmark runner: the firmware ELF (built with -Dsimavr_bench) on simavr
+
+  usage: bench_run <firmware.elf> [script]
+
+  Loads the ELF, whose .mmcu section names the MCU, F_CPU and the bench.vcd trace, drives
+  the button pins PC0..PC3 from a press script and runs the core to the end of the script.
+  simavr writes every GPIOR marker, button and LCD pin change to bench.vcd with the cycle
+  it happened on; tools/bench_vcd.py turns that into the benchmark figures.  The pins are
+  added to the trace as S1..S4 by the runner: the firmware's BUTTONS trace watches the PINC
+  address, which simavr updates on CPU writes only, not on a pin change.
+
+  The script is a list of "<ms>:S<n>+<hold ms>" presses and a final "<ms>:end", e.g. the
+  default  1000:S2+100 2000:S1+100 4500:S3+100 6000:end
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_vcd_file.h>
+#include <simavr/avr_ioport.h>
+
+#define press_max   32
+
+struct press {
+    uint64_t at, until;                             // cycles
+    uint8_t button;                                 // 0 - 3 = S1 - S4
+};
+
+static const char *default_script[] = { "1000:S2+100", "2000:S1+100", "4500:S3+100", "6000:end" };
+
+int main(int argc, char **argv)
+{
+    elf_firmware_t firmware;
+    struct press presses[press_max];
+    const char **script = default_script;
+    int count = sizeof(default_script) / sizeof(default_script[0]);
+    int n = 0, i, state;
+    uint64_t end = 0;
+    avr_irq_t *pins[4];
+    avr_t *avr;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <firmware.elf> [<ms>:S<n>+<hold ms> ... <ms>:end]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 2)
+    {
+        script = (const char **)&argv[2];
+        count = argc - 2;
+    }
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[1], &firmware) != 0 || !firmware.mmcu[0] || !firmware.frequency)
+    {
+        fprintf(stderr, "%s: no firmware or no AVR_MCU section in %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    if ((avr = avr_make_mcu_by_name(firmware.mmcu)) == NULL)
+    {
+        fprintf(stderr, "%s: simavr does not know %s\n", argv[0], firmware.mmcu);
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);              // also opens and starts bench.vcd
+
+    for (i = 0; i < count; i++)                     // milliseconds to cycles
+    {
+        char *rest;
+        uint64_t at = strtoull(script[i], &rest, 10) * firmware.frequency / 1000;
+
+        if (!strcmp(rest, ":end"))
+            end = at;
+        else if (n < press_max && rest[0] == ':' && rest[1] == 'S' && rest[2] >= '1' && rest[2] <= '4' && rest[3] == '+')
+        {
+            presses[n].at = at;
+            presses[n].until = at + strtoull(rest + 4, NULL, 10) * firmware.frequency / 1000;
+            presses[n].button = rest[2] - '1';
+            n++;
+        }
+        else
+        {
+            fprintf(stderr, "%s: bad script entry %s\n", argv[0], script[i]);
+            return 2;
+        }
+    }
+    if (!end)
+    {
+        fprintf(stderr, "%s: the script needs an <ms>:end entry\n", argv[0]);
+        return 2;
+    }
+
+    if (!avr->vcd)
+    {
+        fprintf(stderr, "%s: %s has no AVR_MCU_VCD_FILE - build it with -Dsimavr_bench\n", argv[0], argv[1]);
+        return 1;
+    }
+    avr_vcd_stop(avr->vcd);                         // restarted below with the button pins in it
+    for (i = 0; i < 4; i++)                         // buttons released - the pins read high
+    {
+        static const char *names[4] = { "S1", "S2", "S3", "S4" };
+
+        pins[i] = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), i);
+        avr_vcd_add_signal(avr->vcd, pins[i], 1, names[i]);
+        avr_raise_irq(pins[i], 1);
+    }
+    avr_vcd_start(avr->vcd);
+    state = cpu_Running;
+    while (avr->cycle < end && state != cpu_Done && state != cpu_Crashed)
+    {
+        for (i = 0; i < n; i++)
+        {
+            uint8_t level = !(avr->cycle >= presses[i].at && avr->cycle < presses[i].until);
+
+            if (pins[presses[i].button]->value != level)
+                avr_raise_irq(pins[presses[i].button], level);
+        }
+        state = avr_run(avr);
+    }
+    if (state == cpu_Crashed)
+        fprintf(stderr, "%s: the firmware crashed at cycle %llu\n", argv[0], (unsigned long long)avr->cycle);
+    avr_terminate(avr);                             // flushes and closes bench.vcd
+    return state == cpu_Crashed;
+}
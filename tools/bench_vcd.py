@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+"""Benchmark figures from the bench.vcd simavr writes for a -Dsimavr_bench firmware
+
+usage: bench_vcd.py [--f-cpu HZ] [--max NAME=CYCLES ...] bench.vcd
+
+Prints one JSON object with the min, max, mean and count, in CPU cycles, of
+  button_to_lcd   a button pressed -> the first E pulse to the LCD after the redraw it starts
+  redraw          MAIN_MARK bench_Redraw: frame queued -> on the display
+  lcd_init        MAIN_MARK bench_LcdInit: lcd_init_4d sequence
+  wakeup          a button pressed while SLEEP is set -> SLEEP cleared in the PCINT1 handler
+  isr             ISR_MARK, per handler: its execution time, and its duty cycle - the share
+                  of the whole trace spent in it (handlers do not nest, so the codes do not
+                  overlap)
+  melody          the buzzer handler (TIMER4_OVF, the DDS) while a melody plays - from the
+                  first to the last sample of each run of samples: its samples per second and
+                  duty cycle; n 0 when no alarm rang in the trace (see make bench-melody)
+MAIN_MARK holds one bit per section, as the sections can overlap.
+--max makes the exit status 1 when a figure's max is over its limit, so a CI job can gate on
+it, e.g. --max redraw=40000 --max wakeup=20000 --max isr.buzzer=400.
+"""
+import argparse
+import json
+import re
+import sys
+
+BENCH_LCD_INIT = 0x01
+BENCH_REDRAW = 0x02
+BENCH_BUZZER_ISR = 0x14
+MELODY_GAP_NS = 1e6                                 # samples further apart: the buzzer stopped
+ISRS = {0x10: 'PCINT1', 0x11: 'tick', 0x12: 'lcd_byte', 0x13: 'button_sample', 0x14: 'buzzer',
+        0x15: 'eeprom', 0x16: 'usart'}
+UNITS = {'s': 1e9, 'ms': 1e6, 'us': 1e3, 'ns': 1.0, 'ps': 1e-3, 'fs': 1e-6}
+
+
+def read_vcd(path):
+    """(timescale in ns, end time, {name: [(time, value), ...]}) - value None for x or z"""
+    scale, names, changes, time = 1.0, {}, {}, 0
+    with open(path) as vcd:
+        text = vcd.read()
+    header, _, body = text.partition('$enddefinitions')
+    m = re.search(r'\$timescale\s+(\d+)\s*(\w+)\s+\$end', header)
+    if m:
+        scale = int(m.group(1)) * UNITS[m.group(2)]
+    for m in re.finditer(r'\$var\s+\S+\s+\d+\s+(\S+)\s+(\S+)(?:\s+\[[^\]]*\])?\s+\$end', header):
+        names.setdefault(m.group(1), []).append(m.group(2))
+        changes[m.group(2)] = []
+    tokens = body.split()
+    i = 1 if tokens and tokens[0] == '$end' else 0
+    while i < len(tokens):
+        token = tokens[i]
+        if token.startswith('#'):
+            time = int(token[1:])
+        elif token[0] in 'bBrR':
+            value, ident = token[1:], tokens[i + 1]
+            i += 1
+            for signal in names.get(ident, []):
+                changes[signal].append((time, None if re.search('[xXzZ]', value) else int(value, 2)))
+        elif token[0] in '01xXzZ' and len(token) > 1:
+            for signal in names.get(token[1:], []):
+                changes[signal].append((time, int(token[0]) if token[0] in '01' else None))
+        i += 1
+    return scale, time, changes
+
+
+def edges(trace, test):
+    """times at which test(previous, value) holds"""
+    previous, found = None, []
+    for time, value in trace:
+        if value is not None and value != previous and test(previous, value):
+            found.append(time)
+        previous = value
+    return found
+
+
+def spans(trace, bit):
+    """(start, end) of every section marked with bit in a marker register"""
+    found, start = [], None
+    for time, value in trace:
+        on = value is not None and value & bit
+        if on and start is None:
+            start = time
+        elif not on and start is not None:
+            found.append((start, time))
+            start = None
+    return found
+
+
+def isr_spans(trace):
+    """{code: [(start, end), ...]} of the handlers marked in ISR_MARK"""
+    found, code, start = {}, None, None
+    for time, value in trace:
+        if value == code:
+            continue
+        if code:
+            found.setdefault(code, []).append((start, time))
+        code, start = value, time
+    return found
+
+
+def level_at(trace, time):
+    value = None
+    for t, v in trace:
+        if t > time:
+            break
+        value = v
+    return value
+
+
+def button_presses(changes):
+    """times of a press (pin falling) - from the runner's S1..S4 pins, else from BUTTONS"""
+    pins = [changes[n] for n in ('S1', 'S2', 'S3', 'S4') if n in changes]
+    if not pins:
+        pins = [changes[n] for n in changes if n.startswith('BUTTONS.')]
+    presses = []
+    for trace in pins:
+        presses += edges(trace, lambda old, new: old == 1 and new == 0)
+    if not pins and 'BUTTONS' in changes:
+        presses = edges(changes['BUTTONS'], lambda old, new: old is not None and (old & ~new & 0x0F) != 0)
+    return sorted(presses)
+
+
+def lcd_strobes(changes):
+    if 'LCD_RS_E.1' in changes:
+        return edges(changes['LCD_RS_E.1'], lambda old, new: new == 1)
+    if 'LCD_RS_E' in changes:
+        return edges(changes['LCD_RS_E'], lambda old, new: new & 0x02 and not (old or 0) & 0x02)
+    return []
+
+
+def summary(values, cycles_per_tick):
+    if not values:
+        return {'n': 0}
+    cycles = [round(v * cycles_per_tick) for v in values]
+    return {'min': min(cycles), 'max': max(cycles), 'mean': round(sum(cycles) / len(cycles)), 'n': len(cycles)}
+
+
+def isr_figures(changes, end, cycles_per_tick):
+    trace = changes.get('ISR_MARK', [])
+    length = end - trace[0][0] if trace and end > trace[0][0] else 0
+    figures = {}
+    for code, found in sorted(isr_spans(trace).items()):
+        times = [stop - start for start, stop in found]
+        figure = summary(times, cycles_per_tick)
+        figure['duty'] = round(sum(times) / length, 6) if length else 0
+        figures[ISRS.get(code, '0x%02X' % code)] = figure
+    return figures
+
+
+def melody_figure(changes, scale, cycles_per_tick):
+    samples = isr_spans(changes.get('ISR_MARK', [])).get(BENCH_BUZZER_ISR, [])
+    if not samples:
+        return {'n': 0}
+    playing, busy, first = 0, 0, samples[0][0]
+    for i, (start, stop) in enumerate(samples):
+        busy += stop - start
+        if i + 1 == len(samples) or (samples[i + 1][0] - start) * scale > MELODY_GAP_NS:
+            playing += stop - first                 # the end of a run of samples
+            if i + 1 < len(samples):
+                first = samples[i + 1][0]
+    return {'n': len(samples), 'playing_ms': round(playing * scale / 1e6, 3),
+            'sample_hz': round(len(samples) / (playing * scale / 1e9)) if playing else 0,
+            'cycles': round(busy * cycles_per_tick), 'duty': round(busy / playing, 6) if playing else 0}
+
+
+def measure(changes, end, scale, f_cpu):
+    main = changes.get('MAIN_MARK', [])
+    sleep = changes.get('SLEEP', [])
+    presses = button_presses(changes)
+    strobes = lcd_strobes(changes)
+    redraws = spans(main, BENCH_REDRAW)
+    button_to_lcd, wakeup = [], []
+    for press in presses:
+        redraw = next((start for start, _ in redraws if start >= press), None)
+        if redraw is not None:
+            strobe = next((t for t in strobes if t >= redraw), None)
+            if strobe is not None:
+                button_to_lcd.append(strobe - press)
+        if level_at(sleep, press) == 1:
+            woken = next((t for t, v in sleep if t > press and v == 0), None)
+            if woken is not None:
+                wakeup.append(woken - press)
+    cycles_per_tick = scale * f_cpu / 1e9
+    return {
+        'button_to_lcd': summary(button_to_lcd, cycles_per_tick),
+        'redraw': summary([end - start for start, end in redraws], cycles_per_tick),
+        'lcd_init': summary([end - start for start, end in spans(main, BENCH_LCD_INIT)], cycles_per_tick),
+        'wakeup': summary(wakeup, cycles_per_tick),
+        'isr': isr_figures(changes, end, cycles_per_tick),
+        'melody': melody_figure(changes, scale, cycles_per_tick),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='benchmark figures from bench.vcd')
+    parser.add_argument('vcd')
+    parser.add_argument('--f-cpu', type=float, default=16e6, help='CPU clock in Hz (default 16000000)')
+    parser.add_argument('--max', action='append', default=[], metavar='NAME=CYCLES',
+                        help='fail when the max of a figure is over CYCLES')
+    args = parser.parse_args()
+    scale, end, changes = read_vcd(args.vcd)
+    figures = measure(changes, end, scale, args.f_cpu)
+    figures['f_cpu'] = int(args.f_cpu)
+    print(json.dumps(figures, indent=2))
+    failed = False
+    for limit in args.max:
+        name, _, cycles = limit.partition('=')
+        figure = figures
+        for part in name.split('.'):                # isr.<handler>
+            figure = figure.get(part) if isinstance(figure, dict) else None
+        if figure is None and name[4:] in ISRS.values() and name.startswith('isr.'):
+            figure = {'n': 0}                       # the handler did not run
+        if not isinstance(figure, dict) or not cycles.isdigit():
+            parser.error('bad limit ' + limit)
+        if figure.get('max', 0) > int(cycles):
+            print('%s: max %d cycles is over the limit of %s' % (name, figure['max'], cycles), file=sys.stderr)
+            failed = True
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
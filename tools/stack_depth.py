@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Worst-case stack depth from the call graph gcc writes with -fcallgraph-info=su
+
+usage: stack_depth.py [--indirect REGEX] [--call-bytes N] [--max BYTES] FILE.ci ...
+
+Adds up the static frame sizes along the deepest call path from main() and from every
+interrupt handler (__vector_N, or NAME_vect in the host build), with --call-bytes (2 on the
+ATmega328PB) for the return address of each call.  The handlers do not nest, so the worst
+case is main's deepest path plus the deepest handler plus one more return address.
+
+Calls through a pointer go to the "__indirect_call" placeholder; --indirect gives a regular
+expression for the functions they may reach (the scheduler's tasks: 'task_\\w+').  Frames
+gcc cannot bound (alloca, variable-length arrays), recursion, and calls to functions it did
+not compile (avr-libc) are listed, since the figure does not cover them.  --max makes the
+exit status 1 when the worst case is over BYTES.
+"""
+import argparse
+import re
+import sys
+
+NODE = re.compile(r'node:\s*\{\s*title:\s*"([^"]+)"\s*label:\s*"([^"]*)"')
+EDGE = re.compile(r'edge:\s*\{\s*sourcename:\s*"([^"]+)"\s*targetname:\s*"([^"]+)"')
+FRAME = re.compile(r'(\d+) bytes \((\w+(?:,\w+)?)\)')
+INDIRECT = '__indirect_call'
+
+
+def read_graph(paths):
+    frames, kinds, calls = {}, {}, {}
+    for path in paths:
+        with open(path) as ci:
+            text = ci.read()
+        for title, label in NODE.findall(text):
+            m = FRAME.search(label)
+            if m:
+                frames[title] = int(m.group(1))
+                kinds[title] = m.group(2)
+        for source, target in EDGE.findall(text):
+            calls.setdefault(source, [])
+            if target not in calls[source]:
+                calls[source].append(target)
+    return frames, kinds, calls
+
+
+class Depth:
+    def __init__(self, frames, calls, indirect, call_bytes):
+        self.frames, self.calls, self.call_bytes = frames, calls, call_bytes
+        self.indirect = sorted(f for f in frames if indirect and re.fullmatch(indirect, f))
+        self.memo, self.active = {}, set()
+        self.recursive, self.unknown = set(), set()
+
+    def callees(self, function):
+        for target in self.calls.get(function, []):
+            if target == INDIRECT:
+                if not self.indirect:
+                    self.unknown.add('%s (call through a pointer)' % function)
+                yield from self.indirect
+            else:
+                yield target
+
+    def deepest(self, function):
+        """(bytes, path) of the deepest chain starting in function"""
+        if function in self.memo:
+            return self.memo[function]
+        if function not in self.frames:
+            self.unknown.add(function)
+            return 0, [function]
+        if function in self.active:
+            self.recursive.add(function)
+            return 0, [function + ' (recursion)']
+        self.active.add(function)
+        best = (0, [])
+        for target in self.callees(function):
+            depth, path = self.deepest(target)
+            if depth + self.call_bytes > best[0] or not best[1]:
+                best = (depth + self.call_bytes, path)
+        self.active.discard(function)
+        result = (self.frames[function] + best[0], [function] + best[1])
+        self.memo[function] = result
+        return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description='worst-case stack depth from gcc call graphs')
+    parser.add_argument('files', nargs='+')
+    parser.add_argument('--indirect', default='', help='regex of the functions calls through pointers reach')
+    parser.add_argument('--call-bytes', type=int, default=2, help='return address bytes per call (default 2)')
+    parser.add_argument('--max', type=int, help='fail when the worst case is over this many bytes')
+    args = parser.parse_args()
+    frames, kinds, calls = read_graph(args.files)
+    if 'main' not in frames:
+        parser.error('no main() in the call graph')
+    depth = Depth(frames, calls, args.indirect, args.call_bytes)
+    handlers = sorted(f for f in frames if re.fullmatch(r'__vector_\d+|\w+_vect', f))
+
+    def show(name):
+        total, path = depth.deepest(name)
+        print('%5d  %s' % (total, ' -> '.join('%s %d' % (f, frames[f]) if f in frames else f for f in path)))
+        return total
+
+    print('bytes  deepest path (function and its frame)')
+    worst_main = show('main')
+    worst_isr = max([show(h) for h in handlers] or [0])
+    worst = worst_main + worst_isr + (args.call_bytes if handlers else 0)
+    print('worst case: %d bytes (main %d + deepest handler %d + its return address)' % (worst, worst_main, worst_isr))
+    dynamic = sorted(f for f in frames if kinds[f] != 'static')
+    if dynamic:
+        print('frames not fixed at compile time: ' + ', '.join('%s (%s)' % (f, kinds[f]) for f in dynamic))
+    if depth.recursive:
+        print('recursion through: ' + ', '.join(sorted(depth.recursive)))
+    if depth.unknown:
+        print('not counted: ' + ', '.join(sorted(depth.unknown)))
+    if args.max is not None and worst > args.max:
+        print('over the limit of %d bytes' % args.max, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
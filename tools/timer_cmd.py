@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Send commands to the timer's serial port and print the replies
+
+usage: timer_cmd.py PORT [COMMAND ...]
+
+PORT is the board's serial device (e.g. /dev/ttyUSB0) or the pseudo-terminal that
+"build/host/timer -p" prints.  Each COMMAND (or each line of standard input when none are
+given) is sent with a CR, and every line the firmware sends is printed until the reply that
+ends it: OK, ERR, or the one-line report of ?, N, K, W and O.  The exit status is 1 when a
+command was answered ERR or not at all.  A spare CR goes first, since the start bit that
+wakes the CPU from power-save may be lost.
+
+  tools/timer_cmd.py /dev/pts/3 "T 07 2959" "A 0 0730 1F 1 01" "?"
+"""
+import os
+import select
+import sys
+import termios
+import time
+import tty
+
+TIMEOUT_S = 2.0
+REPORTS = {'?': 'S', 'N': 'N', 'K': 'K', 'W': 'W', 'O': 'O'}
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    attrs[4] = attrs[5] = termios.B38400
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+class Lines:
+    def __init__(self, fd):
+        self.fd, self.buffer = fd, b''
+
+    def next(self, timeout):
+        """the next line without CR LF, None after timeout seconds of silence"""
+        deadline = time.monotonic() + timeout
+        while b'\n' not in self.buffer:
+            left = deadline - time.monotonic()
+            if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+                return None
+            self.buffer += os.read(self.fd, 256)
+        line, _, self.buffer = self.buffer.partition(b'\n')
+        return line.decode('ascii', 'replace').rstrip('\r')
+
+
+def command(fd, lines, text):
+    """send one command, print its reply; True unless it failed"""
+    os.write(fd, text.encode('ascii') + b'\r')
+    report = REPORTS.get(text.strip()[:1].upper())
+    while True:
+        line = lines.next(TIMEOUT_S)
+        if line is None:
+            print('%s: no reply' % text, file=sys.stderr)
+            return False
+        print(line)
+        if line in ('OK', 'ERR'):
+            return line == 'OK'
+        if report and line.startswith(report + ' '):
+            return True
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+    fd = open_port(sys.argv[1])
+    lines = Lines(fd)
+    os.write(fd, b'\r')
+    time.sleep(0.05)
+    termios.tcflush(fd, termios.TCIFLUSH)
+    commands = sys.argv[2:] or (line.strip() for line in sys.stdin)
+    ok = True
+    for text in commands:
+        if text:
+            ok = command(fd, lines, text) and ok
+    os.close(fd)
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
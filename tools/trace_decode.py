@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Timeline and button-to-display latency from the trace buffer dump (serial command L)
+
+usage: trace_decode.py [--tick-rtc] [--bucket MS] [--quiet] [FILE ...]
+
+Reads the "L <code> <data> <time>" lines of one or more dumps (a firmware built with
+-Dtrace_buffer) from the files or standard input; other lines, such as the OK ending each
+dump or a "uart> " prefix from build/host/timer, are skipped, and a line that is not a
+record ends a dump.  Prints each dump as a timeline in microseconds from its first record,
+then a histogram of the latency from the PCINT1 handler (the first edge of a press) to the
+ev_LcdIdle that ends the redraw of that press.  Dump the buffer soon after each short press:
+it holds only the last trace_size records, and every 8 mS sample of a held button adds four,
+so a press held much over 100 mS pushes its own PCINT1 record out.
+
+The time stamps are TCNT1, counting 16 uS and wrapping at 62500 with the Timer1 tick, or
+with --tick-rtc 32 uS and wrapping at 65536; records are taken to be less than one wrap
+apart.
+"""
+import argparse
+import re
+import sys
+
+CODES = {1: 'isr', 2: 'main', 3: 'sleep', 4: 'event', 5: 'lcd'}
+ISRS = {0x00: 'end', 0x10: 'PCINT1', 0x11: 'tick', 0x12: 'LCD byte', 0x13: 'button sample',
+        0x14: 'buzzer', 0x15: 'EEPROM', 0x16: 'USART'}
+MAINS = {0x01: 'lcd_init_4d', 0x02: 'redraw'}
+MAIN_END = 0x80
+EVENTS = {0x00: 'ev_None', 0x10: 'ev_Buttons', 0x20: 'ev_Tick', 0x30: 'ev_Done', 0x40: 'ev_LcdIdle',
+          0x50: 'ev_ClockAlarm', 0x60: 'ev_NewDay', 0x70: 'ev_Released', 0x80: 'ev_LongPress',
+          0x90: 'ev_Command'}
+ISR_PCINT1 = 0x10
+EV_BUTTONS = 0x10
+EV_LCD_IDLE = 0x40
+RECORD = re.compile(r'(?:^|\s)L ([0-9A-Fa-f]{2}) ([0-9A-Fa-f]{2}) ([0-9A-Fa-f]{4})\s*$')
+
+
+def read_dumps(files):
+    """lists of (code, data, count) records, one list per dump"""
+    dumps, dump = [], []
+    for source in files:
+        for line in source:
+            m = RECORD.search(line)
+            if m:
+                dump.append(tuple(int(g, 16) for g in m.groups()))
+            elif dump:
+                dumps.append(dump)
+                dump = []
+    if dump:
+        dumps.append(dump)
+    return dumps
+
+
+def unwrap(dump, wrap, unit_us):
+    """(time in uS from the first record, code, data)"""
+    records, base, previous = [], 0, None
+    for code, data, count in dump:
+        if previous is not None and count < previous:
+            base += wrap
+        previous = count
+        records.append(((base + count - dump[0][2]) * unit_us, code, data))
+    return records
+
+
+def describe(code, data):
+    if code == 1:
+        return 'isr    ' + ISRS.get(data, '0x%02X' % data)
+    if code == 2:
+        name = MAINS.get(data & ~MAIN_END, '0x%02X' % (data & ~MAIN_END))
+        return 'main   ' + (name + ' end' if data & MAIN_END else name)
+    if code == 3:
+        return 'sleep  ' + ('asleep' if data else 'awake')
+    if code == 4:
+        name = EVENTS.get(data & 0xF0, '0x%02X' % data)
+        return 'event  ' + (name + ' 0x%X' % (data & 0x0F) if data & 0x0F else name)
+    if code == 5:
+        return 'lcd    instruction 0x%02X' % data
+    return '0x%02X   0x%02X' % (code, data)
+
+
+def latencies(records):
+    """PCINT1 entry -> the ev_LcdIdle after the ev_Buttons it led to, in uS"""
+    found, pcint, pressed = [], None, False
+    for time, code, data in records:
+        if code == 1 and data == ISR_PCINT1:
+            pcint, pressed = time, False
+        elif code == 4 and (data & 0xF0) == EV_BUTTONS and pcint is not None:
+            pressed = True
+        elif code == 4 and data == EV_LCD_IDLE and pressed:
+            found.append(time - pcint)
+            pcint, pressed = None, False
+    return found
+
+
+def histogram(values, bucket_ms):
+    if not values:
+        print('no PCINT1 -> ev_LcdIdle sequence found')
+        return
+    ms = [v / 1000 for v in values]
+    print('PCINT1 -> ev_LcdIdle: n %d, min %.2f mS, mean %.2f mS, max %.2f mS'
+          % (len(ms), min(ms), sum(ms) / len(ms), max(ms)))
+    counts = {}
+    for v in ms:
+        counts[int(v // bucket_ms)] = counts.get(int(v // bucket_ms), 0) + 1
+    width = max(counts.values())
+    for b in range(min(counts), max(counts) + 1):
+        n = counts.get(b, 0)
+        print('  %7.2f - %7.2f mS %4d %s' % (b * bucket_ms, (b + 1) * bucket_ms, n, '#' * (n * 50 // width)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='decode trace buffer dumps')
+    parser.add_argument('files', nargs='*', type=argparse.FileType('r'), default=[sys.stdin])
+    parser.add_argument('--tick-rtc', action='store_true', help='time stamps of a tick_rtc build')
+    parser.add_argument('--bucket', type=float, default=2.0, help='histogram bucket in mS (default 2)')
+    parser.add_argument('--quiet', action='store_true', help='histogram only, no timeline')
+    args = parser.parse_args()
+    wrap, unit_us = (65536, 32) if args.tick_rtc else (62500, 16)
+    found = []
+    for n, dump in enumerate(read_dumps(args.files)):
+        records = unwrap(dump, wrap, unit_us)
+        if not args.quiet:
+            print('dump %d' % (n + 1))
+            for time, code, data in records:
+                print('  %10d uS  %s' % (time, describe(code, data)))
+        found += latencies(records)
+    histogram(found, args.bucket)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())